@@ -0,0 +1,97 @@
+#!/bin/bash
+
+# Throughput of the simulation (cigarettes smoked per second) as the number of processors the processes may
+# run on grows, for the working tree and, with -r, for an earlier revision, so that a change can be measured
+# before and after. Each variant is built in a scratch directory with NUMORDERS set to the number of orders.
+#
+# The number of smokers is fixed at three by the problem (one per missing ingredient), so the processors are
+# what varies: with the delays inside the critical region the throughput stays flat, without them it scales.
+
+usage () {
+    echo "USAGE: $0 [-o «orders»] [-n «runs»] [-r «revision»] [-- «options of probSemSharedMemSmokers»]"
+    exit 1
+}
+
+orders=2000
+runs=3
+rev=
+while getopts "o:n:r:" opt; do
+    case $opt in
+        o) orders=$OPTARG;;
+        n) runs=$OPTARG;;
+        r) rev=$OPTARG;;
+        *) usage;;
+    esac
+done
+shift $((OPTIND - 1))
+if ! [ "$orders" -gt 0 ] 2>/dev/null || ! [ "$runs" -gt 0 ] 2>/dev/null; then
+    usage
+fi
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+# build «name» «revision or empty for the working tree»
+build () {
+    mkdir -p "$scratch/$1"
+    if [ -z "$2" ]; then
+        (cd "$top" && tar cf - src run) | tar xf - -C "$scratch/$1"
+    else
+        git -C "$top" archive "$2" src run | tar xf - -C "$scratch/$1" || exit 1
+    fi
+    sed -i "s/^#define  *NUMORDERS .*/#define  NUMORDERS        $orders/" "$scratch/$1/src/probConst.h"
+    if ! make -s -C "$scratch/$1/src" all > "$scratch/$1.log" 2>&1; then
+        echo "Building $1 failed:"
+        cat "$scratch/$1.log"
+        exit 1
+    fi
+}
+
+# measure «name» «processors»: prints cigarettes per second over all the runs
+measure () {
+    local total=0 i t0 t1
+
+    cd "$scratch/$1/run" || exit 1
+    for i in $(seq 1 $runs); do
+        t0=$(date +%s%N)
+        if ! taskset -c 0-$(($2 - 1)) ./probSemSharedMemSmokers "${opts[@]}" > /dev/null 2>&1; then
+            cd - > /dev/null
+            echo "failed"
+            return
+        fi
+        t1=$(date +%s%N)
+        total=$((total + t1 - t0))
+    done
+    cd - > /dev/null
+    awk -v c=$((orders * runs)) -v ns=$total 'BEGIN { printf "%.0f", c * 1e9 / ns }'
+}
+
+opts=("$@")
+build after ""
+variants=after
+if [ -n "$rev" ]; then
+    build before "$rev"
+    variants="before after"
+fi
+
+cpus=1
+list=
+while [ $cpus -lt $(nproc) ]; do
+    list="$list $cpus"
+    cpus=$((cpus * 2))
+done
+list="$list $(nproc)"
+
+printf "%10s" "CPUs"
+for v in $variants; do
+    printf "%12s" "$v"
+done
+printf "   (cigarettes/s, %d orders, %d runs)\n" $orders $runs
+for c in $list; do
+    printf "%10d" $c
+    for v in $variants; do
+        printf "%12s" "$(measure $v $c)"
+    done
+    printf "\n"
+done
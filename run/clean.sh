@@ -1,9 +1,29 @@
 #!/bin/bash
 
+# Removes the error files and the semaphore sets and shared regions left behind by runs that were killed (a run
+# that terminates otherwise releases them). Their keys start with 0x61 ('a': the project id of the key of the
+# current directory and of the keys generated by -k auto), or 0x73 ('s': the blocks of semaphores of the posix,
+# pthread and futex backends). Keys given with -k are passed as arguments.
+# Only to be run when none of your simulations is running.
+
 rm -f error*
 rm -f core
 
-# change 0x610661c3 to your semaphore and shared memory key
-ipcrm -S 0x610795c6
-ipcrm -M 0x610795c6
+me=$(whoami)
+for type in s m; do
+    for key in $(ipcs -$type | awk -v u="$me" '$3 == u && $1 ~ /^0x(61|73)/ { print $1 }'); do
+        ipcrm -$(echo $type | tr sm SM) $key
+    done
+done
 
+for key in "$@"; do
+    # the key is read as parseKey (sharedLocks.c) does for the main program and the monitor
+    if (( key <= 0 || key > 0xffffffff || (key > 0xffffff && (key & 0xff000000) != 0x61000000) )); then
+        echo "Invalid key ($key)!" >&2
+        continue
+    fi
+    key=$(printf "0x%08x" $(($key | 0x61000000)))
+    ipcrm -S $key 2>/dev/null
+    ipcrm -M $key 2>/dev/null
+    ipcrm -M $(printf "0x73%06x" $(($key & 0xffffff))) 2>/dev/null
+done
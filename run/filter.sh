@@ -1,4 +1,3 @@
 #!/bin/bash
 
-./probSemSharedMemSmokers | awk -f filter_log.awk
-
+./probSemSharedMemSmokers | ./logfilter
@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# Coherence traffic of the simulation with the compact and the padded layout of the full state (see
+# probDataStruct.h). Each layout is built in a scratch directory with NUMORDERS set to the number of orders and
+# run under perf stat, which counts the events of every process of the run; the counts are averaged over the runs.
+# The default events are portable; on Intel processors, -e mem_load_l3_hit_retired.xsnp_hitm counts the loads
+# served by a modified line of another core, the cost false sharing adds. Without perf, only the time is reported.
+
+usage () {
+    echo "USAGE: $0 [-o «orders»] [-n «runs»] [-e «events»] [-- «options of probSemSharedMemSmokers»]"
+    exit 1
+}
+
+orders=2000
+runs=3
+events=cache-references,cache-misses,cycles,instructions
+while getopts "o:n:e:" opt; do
+    case $opt in
+        o) orders=$OPTARG;;
+        n) runs=$OPTARG;;
+        e) events=$OPTARG;;
+        *) usage;;
+    esac
+done
+shift $((OPTIND - 1))
+if ! [ "$orders" -gt 0 ] 2>/dev/null || ! [ "$runs" -gt 0 ] 2>/dev/null; then
+    usage
+fi
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+opts=("-l" "off" "$@")
+if command -v perf > /dev/null; then
+    perf=yes
+else
+    echo "perf is not available: only the time of the runs is reported." >&2
+    perf=
+fi
+
+# build «layout»
+build () {
+    mkdir -p "$scratch/$1"
+    (cd "$top" && tar cf - src run) | tar xf - -C "$scratch/$1"
+    sed -i "s/^#define  *NUMORDERS .*/#define  NUMORDERS        $orders/" "$scratch/$1/src/probConst.h"
+    if ! make -s -C "$scratch/$1/src" all LAYOUT=$1 > "$scratch/$1.log" 2>&1; then
+        echo "Building the $1 layout failed:"
+        cat "$scratch/$1.log"
+        exit 1
+    fi
+}
+
+# measure «layout»: prints one line per event (name and count per run) and the time per run
+measure () {
+    local i t0 t1 ns=0
+
+    cd "$scratch/$1/run" || exit 1
+    : > "$scratch/$1.perf"
+    for i in $(seq 1 $runs); do
+        t0=$(date +%s%N)
+        if [ -n "$perf" ]; then
+            perf stat -x, -e "$events" -o "$scratch/$1.perf" --append ./probSemSharedMemSmokers "${opts[@]}" > /dev/null
+        else
+            ./probSemSharedMemSmokers "${opts[@]}" > /dev/null
+        fi
+        if [ $? -ne 0 ]; then
+            echo "A run of the $1 layout failed. Aborting." >&2
+            exit 1
+        fi
+        t1=$(date +%s%N)
+        ns=$((ns + t1 - t0))
+    done
+    cd - > /dev/null
+    awk -F, -v runs=$runs '$1 ~ /^[0-9.]+$/ { n[$3] += $1; if (!($3 in seen)) { seen[$3] = 1; order[k++] = $3 } }
+                           END { for (i = 0; i < k; i++) printf "%s %.0f\n", order[i], n[order[i]] / runs }' \
+        "$scratch/$1.perf"
+    echo "time(ms) $((ns / runs / 1000000))"
+}
+
+build compact
+build padded
+measure compact > "$scratch/compact.out" || exit 1
+measure padded > "$scratch/padded.out" || exit 1
+
+printf "%-40s %16s %16s   (per run, %d orders, %d runs)\n" "event" "compact" "padded" $orders $runs
+paste -d ' ' "$scratch/compact.out" "$scratch/padded.out" | while read -r name c _ p; do
+    printf "%-40s %16s %16s\n" "$name" "$c" "$p"
+done
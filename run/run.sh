@@ -1,5 +1,8 @@
 #!/bin/bash
 
+# Validation sweep: «number-of-runs» runs with a time limit on the downs, carried out in parallel by batch (see
+# batchRunner.c for its options, to be used directly for anything else).
+
 case $# in
     0) n=1000;;
     1) n=$1;;
@@ -11,8 +14,4 @@ if ! [ $n -gt 0 ] 2>/dev/null; then
     exit 1
 fi
 
-for i in $(seq 1 $n)
-do
-     echo -e "\n\e[34;1mRun n.º $i\e[0m"
-     echo -e "stat\ny" | ./probSemSharedMemSmokers
-done
+exec ./batch -n $n -- -T 5000
@@ -0,0 +1,527 @@
+/**
+ *  \file batchRunner.c (implementation file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Batch of runs of the simulation, carried out in parallel.
+ *
+ *  The runner starts probSemSharedMemSmokers, from the current directory, the given number of times, keeping up to
+ *  the given number of runs going at once. Each run is given a seed of its own (<tt>-e</tt>: the base seed plus the
+ *  number of the run) and an IPC namespace of its own, where its key (<tt>-k</tt>) cannot be taken by any other
+ *  run; when namespaces cannot be created, each run generates a unique key instead (<tt>-k auto</tt>).
+ *
+ *  The standard output (the log, unless a log file is given) and the standard error of each run are captured in
+ *  <tt>runNNNN.log</tt> and <tt>runNNNN.err</tt> of the batch directory. A run that is still going after the time
+ *  limit is stopped and reported as hung. The files of a run that failed or hung are kept, along with the error
+ *  files of its entities (moved to <tt>runNNNN.AG</tt>, <tt>runNNNN.WT00</tt>, ...), and the run is reported with
+ *  its seed, so that it can be repeated with <tt>probSemSharedMemSmokers -e seed</tt>; the files of a run that
+ *  succeeded are removed, unless <tt>-K</tt> is given.
+ *
+ *  At the end, the time of the runs (latency) and the cigarettes smoked per second (throughput) are summarized over
+ *  the runs that succeeded. The exit status is a failure when some run failed or hung.
+ *
+ *  Upon execution, the following parameters are accepted:
+ *    \li <tt>-n N</tt> number of runs (1000 by default)
+ *    \li <tt>-j N</tt> number of runs going at once (the number of processors by default)
+ *    \li <tt>-e seed</tt> base seed (one taken from the time by default)
+ *    \li <tt>-t s</tt> time limit of each run (in s, 60 by default)
+ *    \li <tt>-d dir</tt> batch directory (<tt>batch.PID</tt> by default)
+ *    \li <tt>-K</tt> the files of every run are kept
+ *    \li <tt>-x</tt> no run is started after the first one that failed or hung
+ *  and the options after <tt>--</tt> are passed on to every run.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "probConst.h"
+
+/** \brief name of the program of the simulation */
+#define  MAIN           "./probSemSharedMemSmokers"
+
+/** \brief time a stopped run is given to release its resources before it is killed (in s) */
+#define  GRACE          2
+
+/** \brief interval between checks of the time limits (in ms) */
+#define  POLL           100
+
+/** \brief length of the names of the files of a run */
+#define  NAMELEN        256
+
+/**
+ *  \brief Definition of <em>run</em> data type: a run going on.
+ */
+typedef struct {
+    /** \brief process identifier of the generator process (0 when the slot is free) */
+    pid_t pid;
+    /** \brief number of the run (from 1) */
+    unsigned int run;
+    /** \brief seed of the run */
+    unsigned int seed;
+    /** \brief time the run was started */
+    struct timespec start;
+    /** \brief the run was stopped for going past the time limit */
+    bool hung;
+    /** \brief the run was killed, for not terminating after being stopped */
+    bool killed;
+} RUN;
+
+/** \brief batch directory */
+static char *dir;
+
+/** \brief each run gets an IPC namespace of its own */
+static bool isolated;
+
+/**
+ *  \brief Printing the command line syntax and terminating.
+ *
+ *  \param prog name of the program
+ */
+static void usage (char *prog)
+{
+    fprintf (stderr, "USAGE: %s [-n N] [-j N] [-e seed] [-t s] [-d dir] [-K] [-x] [-- options of %s]\n", prog, MAIN);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ *  \brief Time elapsed since a given instant (in ms).
+ *
+ *  \param t0 instant
+ */
+static double since (struct timespec *t0)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t0->tv_sec) * 1000.0 + (now.tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+
+/**
+ *  \brief Writing a short text to a file (a process file, in practice).
+ *
+ *  \param name name of the file
+ *  \param text text to be written
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the file cannot be written (the actual situation is reported in <tt>errno</tt>)
+ */
+static int writeFile (const char *name, const char *text)
+{
+    int fd, n;
+
+    if ((fd = open (name, O_WRONLY)) == -1) {
+        return -1;
+    }
+    n = (int) write (fd, text, strlen (text));
+    close (fd);
+    return (n == (int) strlen (text)) ? 0 : -1;
+}
+
+/**
+ *  \brief Moving the calling process to an IPC namespace of its own.
+ *
+ *  Without the privilege to do so, a user namespace is created along with it, where the user keeps its own ids, so
+ *  that the files it creates are still its own.
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when no namespace can be created (the actual situation is reported in <tt>errno</tt>)
+ */
+static int isolate (void)
+{
+    char map[32];
+    unsigned int uid = (unsigned int) geteuid (),
+                 gid = (unsigned int) getegid ();
+
+    if (unshare (CLONE_NEWIPC) == 0) {
+        return 0;
+    }
+    if (unshare (CLONE_NEWUSER | CLONE_NEWIPC) == -1) {
+        return -1;
+    }
+    sprintf (map, "%u %u 1", uid, uid);
+    if (writeFile ("/proc/self/uid_map", map) == -1) {
+        return -1;
+    }
+    sprintf (map, "%u %u 1", gid, gid);
+    if ((writeFile ("/proc/self/setgroups", "deny") == -1) || (writeFile ("/proc/self/gid_map", map) == -1)) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  \brief Checking whether the runs can be given IPC namespaces of their own, in a process created to that end.
+ */
+static bool canIsolate (void)
+{
+    pid_t pid;
+    int status;
+
+    if ((pid = fork ()) < 0) {
+        perror ("error on the fork operation");
+        exit (EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        _exit ((isolate () == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    return (waitpid (pid, &status, 0) == pid) && WIFEXITED (status) && (WEXITSTATUS (status) == EXIT_SUCCESS);
+}
+
+/**
+ *  \brief Starting a run.
+ *
+ *  \param r pointer to the slot of the run, with its number and seed filled in
+ *  \param opts options passed on to the run
+ *  \param nOpts number of options
+ *  \param mask signal mask to be restored in the run
+ */
+static void startRun (RUN *r, char *opts[], int nOpts, sigset_t *mask)
+{
+    char name[NAMELEN], seed[12], key[12];
+    char *args[nOpts + 6];
+    int fd, a = 0;
+
+    clock_gettime (CLOCK_MONOTONIC, &r->start);
+    r->hung = r->killed = false;
+    if ((r->pid = fork ()) < 0) {
+        perror ("error on the fork operation for a run");
+        exit (EXIT_FAILURE);
+    }
+    if (r->pid != 0) {
+        return;
+    }
+
+    sigprocmask (SIG_SETMASK, mask, NULL);
+    sprintf (name, "%s/run%04u.log", dir, r->run);
+    if (((fd = open (name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) || (dup2 (fd, STDOUT_FILENO) == -1)) {
+        perror ("error on creating the log of a run");
+        _exit (EXIT_FAILURE);
+    }
+    close (fd);
+    sprintf (name, "%s/run%04u.err", dir, r->run);
+    if (((fd = open (name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) || (dup2 (fd, STDERR_FILENO) == -1)) {
+        perror ("error on creating the error output of a run");
+        _exit (EXIT_FAILURE);
+    }
+    close (fd);
+    if (((fd = open ("/dev/null", O_RDONLY)) != -1) && (dup2 (fd, STDIN_FILENO) != -1)) {
+        close (fd);
+    }
+    if (isolated && (isolate () == -1)) {
+        perror ("error on creating the IPC namespace of a run");
+        _exit (EXIT_FAILURE);
+    }
+
+    sprintf (seed, "%u", r->seed);
+    if (isolated) {
+        sprintf (key, "0x%08x", 0x61000000 | r->run);               /* unique in the batch, for the error files */
+    }
+    else strcpy (key, "auto");
+    args[a++] = MAIN;
+    args[a++] = "-e";
+    args[a++] = seed;
+    args[a++] = "-k";
+    args[a++] = key;
+    while (a - 5 < nOpts) {
+        args[a] = opts[a-5];
+        a += 1;
+    }
+    args[a] = NULL;
+    execv (MAIN, args);
+    perror ("error on the generation of a run");
+    _exit (EXIT_FAILURE);
+}
+
+/**
+ *  \brief Key of a run, the one it was given or the one it reported on its standard error.
+ *
+ *  \param r pointer to the slot of the run
+ *
+ *  \return the key, or -1 if the run terminated before creating its shared resources
+ */
+static long runKey (RUN *r)
+{
+    char name[NAMELEN], line[256];
+    unsigned int key;
+    long found = -1;
+    FILE *f;
+
+    if (isolated) {
+        return 0x61000000 | r->run;
+    }
+    sprintf (name, "%s/run%04u.err", dir, r->run);
+    if ((f = fopen (name, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets (line, sizeof (line), f) != NULL) {
+        if (sscanf (line, "Key of the run: 0x%x", &key) == 1) {
+            found = key;
+            break;
+        }
+    }
+    fclose (f);
+    return found;
+}
+
+/**
+ *  \brief Disposing of the files of a terminated run: they are removed, or kept in the batch directory.
+ *
+ *  \param r pointer to the slot of the run
+ *  \param keep the files are kept
+ */
+static void disposeRun (RUN *r, bool keep)
+{
+    char name[NAMELEN], entity[NAMELEN], tag[8];
+    long key = runKey (r);
+    unsigned int e;
+
+    for (e = 0; (key != -1) && (e < 2 + NUMINGREDIENTS + NUMSMOKERS); e++) {
+        if (e == 0) {
+            strcpy (tag, "AG");
+        }
+        else if (e == 1) {
+            strcpy (tag, "LG");
+        }
+        else if (e < 2 + NUMINGREDIENTS) {
+            sprintf (tag, "WT%02u", e - 2);
+        }
+        else sprintf (tag, "SM%02u", e - 2 - NUMINGREDIENTS);
+        sprintf (entity, "error_%s.%08lx", tag, key);
+        sprintf (name, "%s/run%04u.%s", dir, r->run, tag);
+        if (keep) {
+            rename (entity, name);
+        }
+        else unlink (entity);
+    }
+    if (!keep) {
+        sprintf (name, "%s/run%04u.log", dir, r->run);
+        unlink (name);
+        sprintf (name, "%s/run%04u.err", dir, r->run);
+        unlink (name);
+    }
+}
+
+/**
+ *  \brief Comparison of two times, for sorting.
+ */
+static int compare (const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ *  \brief Printing the summary of the batch.
+ *
+ *  \param ms time of each run that succeeded (in ms), sorted in place
+ *  \param cpu processor time of each run that succeeded, its entities included (in ms)
+ *  \param n number of runs that succeeded
+ *  \param wall time of the whole batch (in ms)
+ */
+static void summarize (double ms[], double cpu[], unsigned int n, double wall)
+{
+    double sum = 0.0, sq = 0.0, tput = 0.0, tsq = 0.0, cpuSum = 0.0, mean, tmean;
+    unsigned int i;
+
+    if (n == 0) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        sum += ms[i];
+        sq += ms[i] * ms[i];
+        tput += NUMORDERS * 1000.0 / ms[i];
+        tsq += (NUMORDERS * 1000.0 / ms[i]) * (NUMORDERS * 1000.0 / ms[i]);
+        cpuSum += cpu[i];
+    }
+    mean = sum / n;
+    tmean = tput / n;
+    qsort (ms, n, sizeof (double), compare);
+#define  PCT(q)   ms[(unsigned int) ceil ((q) * n) - 1]
+    printf ("Time of a run (ms): min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, max %.1f, mean %.1f, stddev %.1f\n",
+            ms[0], PCT (0.5), PCT (0.9), PCT (0.99), ms[n-1], mean, sqrt (fmax (sq / n - mean * mean, 0.0)));
+#undef   PCT
+    printf ("Processor time of a run (ms): mean %.1f\n", cpuSum / n);
+    printf ("Cigarettes per second: %.0f per run (stddev %.0f), %.0f over the batch (%.2f s)\n", tmean,
+            sqrt (fmax (tsq / n - tmean * tmean, 0.0)), (double) n * NUMORDERS * 1000.0 / wall, wall / 1000.0);
+}
+
+/**
+ *  \brief Main program.
+ */
+int main (int argc, char *argv[])
+{
+    unsigned int nRuns = 1000,                                                                    /* number of runs */
+                 jobs = 0,                                                             /* number of runs at once */
+                 limit = 60,                                                           /* time limit of a run (s) */
+                 base = 0,                                                                             /* base seed */
+                 next = 1,                                                                  /* next run to be started */
+                 going = 0,                                                                /* number of runs going */
+                 ok = 0, failed = 0, hung = 0,                                                       /* run outcomes */
+                 j;
+    bool seeded = false,                                                                     /* a base seed was given */
+         keep = false,                                                                   /* every file is kept */
+         stopFirst = false;                                                 /* no run is started after a failure */
+    char defDir[32];                                                                    /* default batch directory */
+    RUN *runs;                                                                                 /* runs going on */
+    double *ms, *cpu;                                                               /* times of the runs succeeded */
+    struct timespec t0, poll = { .tv_sec = 0, .tv_nsec = POLL * 1000000L };
+    sigset_t chld, mask;
+    struct rusage ru;
+    pid_t pid;
+    int status;
+    char *tinp;                                                                      /* numerical parameters test flag */
+    int opt;                                                                                    /* command line option */
+
+    sprintf (defDir, "batch.%d", (int) getpid ());
+    dir = defDir;
+    while ((opt = getopt (argc, argv, "n:j:e:t:d:Kx")) != -1) {
+        switch (opt) {
+            case 'n': nRuns = (unsigned int) strtoul (optarg, &tinp, 0);
+                      if ((*tinp != '\0') || (nRuns == 0) || (nRuns > 0xffffff)) {
+                          usage (argv[0]);
+                      }
+                      break;
+            case 'j': jobs = (unsigned int) strtoul (optarg, &tinp, 0);
+                      if ((*tinp != '\0') || (jobs == 0)) {
+                          usage (argv[0]);
+                      }
+                      break;
+            case 'e': base = (unsigned int) strtoul (optarg, &tinp, 0);
+                      if (*tinp != '\0') {
+                          usage (argv[0]);
+                      }
+                      seeded = true;
+                      break;
+            case 't': limit = (unsigned int) strtoul (optarg, &tinp, 0);
+                      if ((*tinp != '\0') || (limit == 0)) {
+                          usage (argv[0]);
+                      }
+                      break;
+            case 'd': dir = optarg;
+                      if (strlen (dir) > NAMELEN - 16) {
+                          usage (argv[0]);
+                      }
+                      break;
+            case 'K': keep = true;
+                      break;
+            case 'x': stopFirst = true;
+                      break;
+            default:  usage (argv[0]);
+        }
+    }
+    if (jobs == 0) {
+        jobs = (unsigned int) sysconf (_SC_NPROCESSORS_ONLN);
+    }
+    if (jobs > nRuns) {
+        jobs = nRuns;
+    }
+    if (!seeded) {
+        base = (unsigned int) time (NULL) ^ ((unsigned int) getpid () << 16);
+    }
+    if ((mkdir (dir, 0755) == -1) && (errno != EEXIST)) {
+        perror ("error on creating the batch directory");
+        exit (EXIT_FAILURE);
+    }
+    if (((runs = calloc (jobs, sizeof (RUN))) == NULL) || ((ms = malloc (nRuns * sizeof (double))) == NULL) ||
+        ((cpu = malloc (nRuns * sizeof (double))) == NULL)) {
+        perror ("error on allocating the batch");
+        exit (EXIT_FAILURE);
+    }
+    isolated = canIsolate ();
+    printf ("Batch of %u runs, %u at once, %s, base seed %u, files in %s\n", nRuns, jobs,
+            isolated ? "an IPC namespace per run" : "a unique key per run", base, dir);
+    fflush (stdout);
+
+    /* the terminations of the runs are waited for along with the time limits */
+    sigemptyset (&chld);
+    sigaddset (&chld, SIGCHLD);
+    sigprocmask (SIG_BLOCK, &chld, &mask);
+
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    while ((going > 0) || ((next <= nRuns) && !(stopFirst && (failed + hung > 0)))) {
+        for (j = 0; (j < jobs) && (next <= nRuns) && !(stopFirst && (failed + hung > 0)); j++) {
+            if (runs[j].pid == 0) {
+                runs[j].run = next;
+                runs[j].seed = base + next;
+                if (runs[j].seed == 0) {                                                /* 0 stands for no seed */
+                    runs[j].seed = 1;
+                }
+                startRun (&runs[j], argv + optind, argc - optind, &mask);
+                next += 1;
+                going += 1;
+            }
+        }
+
+        sigtimedwait (&chld, NULL, &poll);
+        while ((pid = wait4 (-1, &status, WNOHANG, &ru)) > 0) {
+            for (j = 0; (j < jobs) && (runs[j].pid != pid); j++);
+            if (j == jobs) {
+                continue;
+            }
+            if (!runs[j].hung && WIFEXITED (status) && (WEXITSTATUS (status) == EXIT_SUCCESS)) {
+                ms[ok] = since (&runs[j].start);
+                cpu[ok] = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+                          (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+                ok += 1;
+                disposeRun (&runs[j], keep);
+            }
+            else {
+                if (runs[j].hung) {
+                    printf ("Run %u (seed %u) hung: stopped after %u s", runs[j].run, runs[j].seed, limit);
+                    hung += 1;
+                }
+                else if (WIFEXITED (status)) {
+                    printf ("Run %u (seed %u) failed: exit status %d", runs[j].run, runs[j].seed,
+                            WEXITSTATUS (status));
+                    failed += 1;
+                }
+                else {
+                    printf ("Run %u (seed %u) failed: killed by signal %d", runs[j].run, runs[j].seed,
+                            WTERMSIG (status));
+                    failed += 1;
+                }
+                printf (" (%s/run%04u.*)\n", dir, runs[j].run);
+                fflush (stdout);
+                disposeRun (&runs[j], true);
+            }
+            runs[j].pid = 0;
+            going -= 1;
+        }
+
+        /* a run past the time limit is stopped, which releases its resources, and killed if it does not terminate */
+        for (j = 0; j < jobs; j++) {
+            if ((runs[j].pid == 0) || runs[j].killed) {
+                continue;
+            }
+            if (!runs[j].hung && (since (&runs[j].start) >= limit * 1000.0)) {
+                kill (runs[j].pid, SIGTERM);
+                runs[j].hung = true;
+            }
+            else if (runs[j].hung && (since (&runs[j].start) >= (limit + GRACE) * 1000.0)) {
+                kill (runs[j].pid, SIGKILL);
+                runs[j].killed = true;
+            }
+        }
+    }
+
+    printf ("Runs: %u started, %u succeeded, %u failed, %u hung\n", next - 1, ok, failed, hung);
+    summarize (ms, cpu, ok, since (&t0));
+    rmdir (dir);                                                               /* only when no file was kept */
+
+    return ((failed + hung == 0) && (next > nRuns)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,134 @@
+/**
+ *  \file deliveryRing.c (implementation file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Delivery of the ingredients from the agent to a watcher.
+ *
+ *  Operations defined on a delivery ring:
+ *     \li initialization
+ *     \li delivery of an ingredient, by the agent
+ *     \li collection of the next ingredient delivered, by the watcher
+ *     \li wake up of the watcher, so that it sees the factory closing.
+ *
+ *  The watcher sets <tt>sleeping</tt> before checking the ring and the closing flag a last time, and the agent
+ *  stores the new head, or the closing flag, before checking <tt>sleeping</tt>; with sequentially consistent
+ *  accesses on both sides, at least one of them sees the other, so a wake up is never lost. Whoever clears
+ *  <tt>sleeping</tt> owns it: the agent then ups the semaphore, and a watcher that finds it already cleared knows
+ *  an up is on its way and absorbs it with the down.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include "deliveryRing.h"
+#include "semaphore.h"
+
+/* wake up of the watcher, if it announced it is about to block */
+static int wake (int semgid, DELIVERY_RING *ring)
+{
+    if ((__atomic_load_n (&ring->sleeping, __ATOMIC_SEQ_CST) != 0) &&
+        (__atomic_exchange_n (&ring->sleeping, 0, __ATOMIC_SEQ_CST) != 0)) {
+        return semUp (semgid, ring->sem);
+    }
+    return 0;
+}
+
+/**
+ *  \brief Initialization of a delivery ring.
+ *
+ *  \param ring pointer to the ring
+ *  \param sem identification of the semaphore where the watcher blocks
+ */
+void createDeliveryRing (DELIVERY_RING *ring, unsigned int sem)
+{
+    memset (ring, 0, sizeof (DELIVERY_RING));
+    ring->sem = sem;
+}
+
+/**
+ *  \brief Delivery of an ingredient, by the agent.
+ *
+ *  The descriptor is stamped with the current time. The agent only waits when the ring is full.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param ring pointer to the ring
+ *  \param order number of the order
+ *  \param ingredient ingredient delivered
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the up of the semaphore fails (the actual situation is reported in <tt>errno</tt>)
+ */
+int ringDeliver (int semgid, DELIVERY_RING *ring, uint32_t order, unsigned int ingredient)
+{
+    uint32_t h = ring->head;
+    DELIVERY *slot = &ring->slot[h % DELIVERY_RING_SIZE];
+    struct timespec now;
+
+    while (h - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE) >= DELIVERY_RING_SIZE) {
+        sched_yield ();
+    }
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    slot->order = order;
+    slot->ingredient = ingredient;
+    slot->time = (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+    __atomic_store_n (&ring->head, h + 1, __ATOMIC_SEQ_CST);
+
+    return wake (semgid, ring);
+}
+
+/**
+ *  \brief Collection of the next ingredient delivered, by the watcher.
+ *
+ *  The watcher blocks while the ring is empty and <tt>*closing</tt> is not set.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param ring pointer to the ring
+ *  \param closing pointer to the flag set by the agent when the factory closes
+ *  \param desc where the descriptor collected is stored
+ *
+ *  \return \c 1, when a descriptor was collected
+ *  \return \c 0, when the ring is empty and the factory is closing
+ *  \return -\c 1, when the down of the semaphore fails (the actual situation is reported in <tt>errno</tt>)
+ */
+int ringCollect (int semgid, DELIVERY_RING *ring, const bool *closing, DELIVERY *desc)
+{
+    uint32_t t = ring->tail;
+
+    while (true) {
+        if (__atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) != t) {
+            *desc = ring->slot[t % DELIVERY_RING_SIZE];
+            __atomic_store_n (&ring->tail, t + 1, __ATOMIC_RELEASE);
+            return 1;
+        }
+        if (__atomic_load_n (closing, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+
+        /* about to block: check once more, now that the agent is bound to see the announcement */
+        __atomic_store_n (&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (((__atomic_load_n (&ring->head, __ATOMIC_SEQ_CST) != t) || __atomic_load_n (closing, __ATOMIC_SEQ_CST)) &&
+            (__atomic_exchange_n (&ring->sleeping, 0, __ATOMIC_SEQ_CST) != 0)) {
+            continue;                                                                        /* no up is on its way */
+        }
+        if (semDown (semgid, ring->sem) == -1) {
+            return -1;
+        }
+    }
+}
+
+/**
+ *  \brief Wake up of the watcher, after the agent set the closing flag.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param ring pointer to the ring
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the up of the semaphore fails (the actual situation is reported in <tt>errno</tt>)
+ */
+int ringWake (int semgid, DELIVERY_RING *ring)
+{
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    return wake (semgid, ring);
+}
@@ -0,0 +1,107 @@
+/**
+ *  \file deliveryRing.h (interface file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Delivery of the ingredients from the agent to a watcher.
+ *
+ *  Operations defined on a delivery ring:
+ *     \li initialization
+ *     \li delivery of an ingredient, by the agent
+ *     \li collection of the next ingredient delivered, by the watcher
+ *     \li wake up of the watcher, so that it sees the factory closing.
+ *
+ *  Each watcher has a ring of its own, with a single producer (the agent) and a single consumer (the watcher), so
+ *  neither side takes a lock. The watcher only blocks, on the semaphore of the ring, when its ring is empty, and the
+ *  agent only ups the semaphore when the watcher announced it is about to block; while deliveries find the watcher
+ *  busy, no system call is made.
+ */
+
+#ifndef DELIVERYRING_H_
+#define DELIVERYRING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** \brief number of slots in a delivery ring (power of 2) */
+#define  DELIVERY_RING_SIZE   8
+
+/**
+ *  \brief Definition of <em>order descriptor</em> data type.
+ */
+typedef struct {
+    /** \brief number of the order (from 0) */
+    uint32_t order;
+    /** \brief ingredient delivered */
+    unsigned int ingredient;
+    /** \brief time of the delivery (CLOCK_MONOTONIC, in ns) */
+    uint64_t time;
+} DELIVERY;
+
+/**
+ *  \brief Definition of <em>delivery ring</em> data type.
+ */
+typedef struct {
+    /** \brief next slot to be filled, written by the agent alone */
+    uint32_t head;
+    /** \brief next slot to be collected, written by the watcher alone */
+    uint32_t tail;
+    /** \brief the watcher is about to block on the semaphore */
+    uint32_t sleeping;
+    /** \brief identification of the semaphore where the watcher blocks – val = 0 */
+    unsigned int sem;
+    /** \brief slots */
+    DELIVERY slot[DELIVERY_RING_SIZE];
+} DELIVERY_RING;
+
+/**
+ *  \brief Initialization of a delivery ring.
+ *
+ *  \param ring pointer to the ring
+ *  \param sem identification of the semaphore where the watcher blocks
+ */
+extern void createDeliveryRing (DELIVERY_RING *ring, unsigned int sem);
+
+/**
+ *  \brief Delivery of an ingredient, by the agent.
+ *
+ *  The descriptor is stamped with the current time. The agent only waits when the ring is full.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param ring pointer to the ring
+ *  \param order number of the order
+ *  \param ingredient ingredient delivered
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the up of the semaphore fails (the actual situation is reported in <tt>errno</tt>)
+ */
+extern int ringDeliver (int semgid, DELIVERY_RING *ring, uint32_t order, unsigned int ingredient);
+
+/**
+ *  \brief Collection of the next ingredient delivered, by the watcher.
+ *
+ *  The watcher blocks while the ring is empty and <tt>*closing</tt> is not set.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param ring pointer to the ring
+ *  \param closing pointer to the flag set by the agent when the factory closes
+ *  \param desc where the descriptor collected is stored
+ *
+ *  \return \c 1, when a descriptor was collected
+ *  \return \c 0, when the ring is empty and the factory is closing
+ *  \return -\c 1, when the down of the semaphore fails (the actual situation is reported in <tt>errno</tt>)
+ */
+extern int ringCollect (int semgid, DELIVERY_RING *ring, const bool *closing, DELIVERY *desc);
+
+/**
+ *  \brief Wake up of the watcher, after the agent set the closing flag.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param ring pointer to the ring
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the up of the semaphore fails (the actual situation is reported in <tt>errno</tt>)
+ */
+extern int ringWake (int semgid, DELIVERY_RING *ring);
+
+#endif /* DELIVERYRING_H_ */
@@ -0,0 +1,353 @@
+/**
+ *  \file logDecode.c (implementation file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Conversion of a binary or delta-encoded log back into the text layout written by saveState, or into CSV.
+ *  Full text logs are accepted as well, and are written unchanged (or converted into CSV).
+ *
+ *  Upon execution, the following parameters are accepted:
+ *    \li <tt>-c</tt> CSV output (one line per record, including sequence number, time and writer for binary logs)
+ *    \li <tt>-s</tt> records of a binary log are sorted by sequence number before being written
+ *    \li name of the log file (stdin if absent).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "probConst.h"
+#include "probDataStruct.h"
+#include "logging.h"
+
+/** \brief number of records read at a time */
+#define  CHUNK          4096
+
+/**
+ *  \brief Printing the command line syntax and terminating.
+ *
+ *  \param prog name of the program
+ */
+static void usage (char *prog)
+{
+    fprintf (stderr, "USAGE: %s [-c] [-s] [logfile]\n", prog);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ *  \brief Rebuilding the full state stored in a binary record.
+ *
+ *  \param p_rec pointer to the binary record
+ *  \param p_fSt pointer to the location where the full state is stored
+ */
+static void unpack (LOG_BIN_RECORD *p_rec, FULL_STAT *p_fSt)
+{
+    int w, s, i;
+
+    SLOT (p_fSt->st.agentStat) = p_rec->agentStat;
+    for (w = 0; w < NUMINGREDIENTS; w++) {
+        SLOT (p_fSt->st.watcherStat[w]) = p_rec->watcherStat[w];
+    }
+    for (s = 0; s < NUMSMOKERS; s++) {
+        SLOT (p_fSt->st.smokerStat[s]) = p_rec->smokerStat[s];
+        SLOT (p_fSt->nCigarettes[s]) = (int) p_rec->nCigarettes[s];
+    }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        SLOT (p_fSt->ingredients[i]) = p_rec->ingredients[i];
+    }
+}
+
+/**
+ *  \brief Writing the CSV header line.
+ *
+ *  \param meta the sequence number, time and writer columns are included
+ */
+static void csvHeader (bool meta)
+{
+    int w, s, i;
+
+    printf ("%sAG", meta ? "seq,time_ns,writer," : "");
+    for (w = 0; w < NUMINGREDIENTS; w++) {
+        printf (",W%02d", w);
+    }
+    for (s = 0; s < NUMSMOKERS; s++) {
+        printf (",S%02d", s);
+    }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        printf (",I%02d", i);
+    }
+    for (s = 0; s < NUMSMOKERS; s++) {
+        printf (",C%02d", s);
+    }
+    printf ("\n");
+}
+
+/**
+ *  \brief Writing a record as a CSV line.
+ *
+ *  \param p_rec pointer to the binary record
+ */
+static void csvRecord (LOG_BIN_RECORD *p_rec)
+{
+    int w, s, i;
+
+    printf ("%u,%llu,%u,%u", p_rec->seq, (unsigned long long) p_rec->time, p_rec->writer, p_rec->agentStat);
+    for (w = 0; w < NUMINGREDIENTS; w++) {
+        printf (",%u", p_rec->watcherStat[w]);
+    }
+    for (s = 0; s < NUMSMOKERS; s++) {
+        printf (",%u", p_rec->smokerStat[s]);
+    }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        printf (",%d", p_rec->ingredients[i]);
+    }
+    for (s = 0; s < NUMSMOKERS; s++) {
+        printf (",%u", p_rec->nCigarettes[s]);
+    }
+    printf ("\n");
+}
+
+/**
+ *  \brief Writing a full state as a CSV line.
+ *
+ *  \param p_fSt pointer to the full state
+ */
+static void csvState (FULL_STAT *p_fSt)
+{
+    unsigned int f;
+
+    for (f = 0; f < LOG_NFIELDS; f++) {
+        printf ((f == 0) ? "%d" : ",%d", getLogField (p_fSt, f));
+    }
+    printf ("\n");
+}
+
+/**
+ *  \brief Parsing a line of a text log.
+ *
+ *  A full record sets all the fields; a delta record (starting with '+') only sets the fields it lists, on top of
+ *  the previous record.
+ *
+ *  \param line line to be parsed
+ *  \param p_fSt pointer to the full state, holding the previous record
+ *
+ *  \return \c 1, if the line is a full record
+ *  \return \c 2, if the line is a delta record
+ *  \return \c 0, otherwise (title, header or anything else)
+ */
+static int parseLine (char *line, FULL_STAT *p_fSt)
+{
+    char *p, *q;                                                                                /* parsing pointers */
+    long f, v;                                                                                   /* field and value */
+    int val[LOG_NFIELDS];                                                                  /* fields of a full record */
+    unsigned int n;
+
+    if (line[0] == '+') {
+        for (p = line + 1; ; p = q + 1) {
+            f = strtol (p, &q, 10);
+            if ((q == p) || (*q != '=') || (f < 0) || (f >= LOG_NFIELDS)) {
+                break;
+            }
+            p = q + 1;
+            v = strtol (p, &q, 10);
+            if (q == p) {
+                break;
+            }
+            setLogField (p_fSt, (unsigned int) f, (int) v);
+        }
+        return 2;
+    }
+
+    for (p = line, n = 0; n < LOG_NFIELDS; n++, p = q) {
+        val[n] = (int) strtol (p, &q, 10);
+        if (q == p) {
+            return 0;
+        }
+    }
+    while ((*p == ' ') || (*p == '\n')) {
+        p++;
+    }
+    if (*p != '\0') {
+        return 0;
+    }
+    for (n = 0; n < LOG_NFIELDS; n++) {
+        setLogField (p_fSt, n, val[n]);
+    }
+    return 1;
+}
+
+/**
+ *  \brief Conversion of a text log, expanding delta records into full lines.
+ *
+ *  \param fic text log file
+ *  \param csv CSV output
+ */
+static void decodeText (FILE *fic, bool csv)
+{
+    char *line = NULL;                                                                            /* line being read */
+    size_t cap = 0;                                                                          /* capacity of line */
+    FULL_STAT fSt;                                                                        /* full state of a record */
+    bool valid = false;                                                          /* a full record was already read */
+    int kind;                                                                                /* kind of line read */
+
+    memset (&fSt, 0, sizeof (fSt));
+    fSt.nIngredients = NUMINGREDIENTS;
+    fSt.nSmokers = NUMSMOKERS;
+    if (csv) {
+        csvHeader (false);
+    }
+
+    while (getline (&line, &cap, fic) != -1) {
+        if ((kind = parseLine (line, &fSt)) == 1) {
+            valid = true;
+        }
+        if ((kind == 2) && !valid) {
+            fprintf (stderr, "Delta record without a previous full record!\n");
+            exit (EXIT_FAILURE);
+        }
+        if (kind == 0) {
+            if (!csv) {                                                       /* title and header are kept as is */
+                flushLog ();
+                fputs (line, stdout);
+                fflush (stdout);
+            }
+        }
+        else if (csv) {
+            csvState (&fSt);
+        }
+        else (saveState) ("", &fSt);                                     /* never compiled out, even with LOG=off */
+    }
+    if (ferror (fic)) {
+        perror ("error on reading log file");
+        exit (EXIT_FAILURE);
+    }
+    free (line);
+}
+
+/**
+ *  \brief Comparison of two records by sequence number (for qsort).
+ */
+static int bySeq (const void *a, const void *b)
+{
+    uint32_t sa = ((const LOG_BIN_RECORD *) a)->seq,
+             sb = ((const LOG_BIN_RECORD *) b)->seq;
+
+    return (sa > sb) - (sa < sb);
+}
+
+/**
+ *  \brief Main program.
+ *
+ *  Its role is reading the binary log header and records and writing them in the requested layout.
+ */
+int main (int argc, char *argv[])
+{
+    FILE *fic = stdin;                                                                          /* binary log file */
+    bool csv = false,                                                                               /* CSV output */
+         sorted = false;                                                           /* sort by sequence number */
+    LOG_BIN_HEADER hdr;                                                                      /* binary file header */
+    LOG_BIN_RECORD *rec = NULL;                                                                     /* records read */
+    size_t nRec = 0,                                                                  /* number of records in rec */
+           cap = 0,                                                                          /* capacity of rec */
+           n, k;
+    FULL_STAT fSt;                                                                     /* full state of a record */
+    LOG_CTRL logCtrl = { .flush = LOG_FLUSH_EXIT, .batch = 1 };              /* text output, written in batches */
+    int opt;                                                                                 /* command line option */
+
+    while ((opt = getopt (argc, argv, "cs")) != -1) {
+        switch (opt) {
+            case 'c': csv = true;
+                      break;
+            case 's': sorted = true;
+                      break;
+            default:  usage (argv[0]);
+        }
+    }
+    if (argc - optind > 1) {
+        usage (argv[0]);
+    }
+    if ((optind < argc) && ((fic = fopen (argv[optind], "rb")) == NULL)) {
+        perror ("error on opening log file");
+        exit (EXIT_FAILURE);
+    }
+
+    /* text logs start with the title line, binary logs with the magic number */
+    if ((opt = getc (fic)) != EOF) {
+        ungetc (opt, fic);
+    }
+    if (opt != LOG_BIN_MAGIC[0]) {
+        if (!csv) {
+            logAttach ("", &logCtrl, NULL, LOG_MAIN);
+        }
+        decodeText (fic, csv);
+        return EXIT_SUCCESS;
+    }
+
+    /* validation of the header against the parameters this program was built with */
+    if (fread (&hdr, sizeof (hdr), 1, fic) != 1) {
+        fprintf (stderr, "Binary log header is missing!\n");
+        exit (EXIT_FAILURE);
+    }
+    if ((memcmp (hdr.magic, LOG_BIN_MAGIC, sizeof (hdr.magic)) != 0) || (hdr.version != LOG_BIN_VERSION)) {
+        fprintf (stderr, "Not a binary log file!\n");
+        exit (EXIT_FAILURE);
+    }
+    if ((hdr.nIngredients != NUMINGREDIENTS) || (hdr.nSmokers != NUMSMOKERS) ||
+        (hdr.recSize != sizeof (LOG_BIN_RECORD))) {
+        fprintf (stderr, "Binary log was written with %u ingredients and %u smokers!\n", hdr.nIngredients, hdr.nSmokers);
+        exit (EXIT_FAILURE);
+    }
+
+    memset (&fSt, 0, sizeof (fSt));
+    fSt.nIngredients = NUMINGREDIENTS;
+    fSt.nSmokers = NUMSMOKERS;
+    if (csv) {
+        csvHeader (true);
+    }
+    else {
+        createLog ("", &fSt);
+        logAttach ("", &logCtrl, NULL, LOG_MAIN);
+    }
+
+    /* records are streamed in chunks, or all kept in memory when they must be sorted */
+    do {
+        if (cap - nRec < CHUNK) {
+            cap = nRec + CHUNK;
+            if ((rec = realloc (rec, cap * sizeof (LOG_BIN_RECORD))) == NULL) {
+                perror ("error on allocating the record buffer");
+                exit (EXIT_FAILURE);
+            }
+        }
+        n = fread (rec + nRec, 1, CHUNK * sizeof (LOG_BIN_RECORD), fic);
+        if (n % sizeof (LOG_BIN_RECORD) != 0) {
+            fprintf (stderr, "Binary log ends with an incomplete record!\n");
+        }
+        n /= sizeof (LOG_BIN_RECORD);
+        nRec += n;
+        if (!sorted || (n < CHUNK)) {
+            if (sorted) {
+                qsort (rec, nRec, sizeof (LOG_BIN_RECORD), bySeq);
+            }
+            for (k = 0; k < nRec; k++) {
+                if (csv) {
+                    csvRecord (&rec[k]);
+                }
+                else {
+                    unpack (&rec[k], &fSt);
+                    (saveState) ("", &fSt);
+                }
+            }
+            nRec = 0;
+        }
+    } while (n == CHUNK);
+
+    if (ferror (fic)) {
+        perror ("error on reading binary log file");
+        exit (EXIT_FAILURE);
+    }
+
+    free (rec);
+    return EXIT_SUCCESS;
+}
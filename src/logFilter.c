@@ -0,0 +1,554 @@
+/**
+ *  \file logFilter.c (implementation file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Streaming filter of the log, replacing each entity state that did not change since the previous record by ".".
+ *
+ *  The number of ingredients and smokers is taken from the column header written by createLog (or from the header
+ *  of a binary log), so a log of any size is accepted regardless of the parameters this program was built with.
+ *  Records are padded like in the log; lines other than records (title, blank line) are written unchanged.
+ *  Delta-encoded records are expanded on top of the previous record, and binary logs are rendered as text.
+ *
+ *  Upon execution, one parameter is accepted:
+ *    \li name of the log file (stdin if absent).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "probConst.h"
+#include "probDataStruct.h"
+#include "logging.h"
+
+/** \brief size of the blocks read from the log (in bytes) */
+#define  INSIZE         (1 << 20)
+
+/** \brief size of the output buffer (in bytes) */
+#define  OUTSIZE        (1 << 20)
+
+/** \brief maximum number of ingredients or smokers in a log */
+#define  MAXENT         64
+
+/** \brief maximum number of fields of a record */
+#define  MAXFIELDS      (1 + 4 * MAXENT)
+
+/** \brief maximum length of a field kept from the previous record */
+#define  TOKMAX         16
+
+/** \brief input buffer; one extra block allows for the line carried over from the previous read */
+static char inBuf[2 * INSIZE];
+
+/** \brief output buffer */
+static char outBuf[OUTSIZE];
+
+/** \brief number of bytes in the output buffer */
+static size_t outLen = 0;
+
+/** \brief number of fields of a record (0 until the header is read) */
+static int nFields = 0;
+
+/** \brief number of leading fields holding entity states, which are filtered */
+static int nStat = 0;
+
+/** \brief width of each field */
+static int width[MAXFIELDS];
+
+/** \brief fields of the previous record */
+static char last[MAXFIELDS][TOKMAX];
+
+/** \brief length of the fields of the previous record */
+static int lastLen[MAXFIELDS];
+
+/** \brief a full record was already read (delta records can be expanded) */
+static bool lastValid = false;
+
+/**
+ *  \brief Printing the command line syntax and terminating.
+ *
+ *  \param prog name of the program
+ */
+static void usage (char *prog)
+{
+    fprintf (stderr, "USAGE: %s [logfile]\n", prog);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ *  \brief Writing the output buffer to stdout.
+ */
+static void flushOut (void)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < outLen) {
+        if ((n = write (STDOUT_FILENO, outBuf + off, outLen - off)) == -1) {
+            perror ("error on writing the filtered log");
+            exit (EXIT_FAILURE);
+        }
+        off += (size_t) n;
+    }
+    outLen = 0;
+}
+
+/**
+ *  \brief Appending bytes to the output buffer.
+ *
+ *  \param p bytes to be appended
+ *  \param len number of bytes
+ */
+static void putOut (const char *p, size_t len)
+{
+    ssize_t n;
+
+    if (outLen + len > OUTSIZE) {
+        flushOut ();
+    }
+    if (len <= OUTSIZE) {
+        memcpy (outBuf + outLen, p, len);
+        outLen += len;
+        return;
+    }
+    while (len > 0) {                                                 /* a huge line is written straight away */
+        if ((n = write (STDOUT_FILENO, p, len)) == -1) {
+            perror ("error on writing the filtered log");
+            exit (EXIT_FAILURE);
+        }
+        p += n;
+        len -= (size_t) n;
+    }
+}
+
+/**
+ *  \brief Appending a field right aligned in <tt>w</tt> characters, followed by a space.
+ *
+ *  \param p field
+ *  \param len length of the field
+ *  \param w width
+ */
+static void putField (const char *p, int len, int w)
+{
+    char *q;
+
+    if (outLen + (size_t) w + (size_t) len + 1 > OUTSIZE) {
+        flushOut ();
+    }
+    q = outBuf + outLen;
+    while (w-- > len) {
+        *q++ = ' ';
+    }
+    memcpy (q, p, (size_t) len);
+    q += len;
+    *q++ = ' ';
+    outLen = (size_t) (q - outBuf);
+}
+
+/**
+ *  \brief Splitting a line into blank-separated fields.
+ *
+ *  With SSE2, sixteen characters are classified at a time and the field boundaries are taken from the resulting
+ *  bit masks.
+ *
+ *  \param line line to be split
+ *  \param len length of the line (without the newline)
+ *  \param tp location where the start of each field is stored
+ *  \param tl location where the length of each field is stored
+ *
+ *  \return number of fields, or \c MAXFIELDS+1 if there are more than MAXFIELDS
+ */
+static int splitFields (const char *line, size_t len, const char *tp[], int tl[])
+{
+    int n = 0;
+    size_t i = 0;
+    bool inTok = false;                                                  /* the previous character is not blank */
+
+#ifdef __SSE2__
+    const __m128i sp = _mm_set1_epi8 (' '),
+                  tab = _mm_set1_epi8 ('\t');
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i c = _mm_loadu_si128 ((const __m128i *) (line + i));
+        unsigned int word = ~(unsigned int) _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (c, sp),
+                                                                             _mm_cmpeq_epi8 (c, tab))) & 0xFFFF;
+        unsigned int prev = ((word << 1) | (inTok ? 1 : 0)) & 0xFFFF;
+        unsigned int edges = word ^ prev;                                       /* starts and ends of fields */
+        int b;
+
+        while (edges != 0) {
+            b = __builtin_ctz (edges);
+            edges &= edges - 1;
+            if (word & (1u << b)) {
+                if (n == MAXFIELDS) {
+                    return MAXFIELDS + 1;
+                }
+                tp[n++] = line + i + b;
+            }
+            else tl[n - 1] = (int) (line + i + b - tp[n - 1]);
+        }
+        inTok = (word & 0x8000) != 0;
+    }
+#endif
+
+    for (; i < len; i++) {
+        bool blank = (line[i] == ' ') || (line[i] == '\t');
+
+        if (!blank && !inTok) {
+            if (n == MAXFIELDS) {
+                return MAXFIELDS + 1;
+            }
+            tp[n++] = line + i;
+        }
+        else if (blank && inTok) {
+            tl[n - 1] = (int) (line + i - tp[n - 1]);
+        }
+        inTok = !blank;
+    }
+    if (inTok) {
+        tl[n - 1] = (int) (line + len - tp[n - 1]);
+    }
+    return n;
+}
+
+/**
+ *  \brief Setting the field layout for a log with <tt>nI</tt> ingredients and <tt>nS</tt> smokers.
+ *
+ *  The agent state takes 3 characters; in each group (watchers, smokers, inventory and cigarettes) the first
+ *  field takes 4 characters and the others 3.
+ */
+static void setLayout (int nI, int nS)
+{
+    int g, k, f = 0;
+    int size[4] = { nI, nS, nI, nS };
+
+    width[f++] = 3;
+    for (g = 0; g < 4; g++) {
+        for (k = 0; k < size[g]; k++) {
+            width[f++] = (k == 0) ? 4 : 3;
+        }
+    }
+    nFields = f;
+    nStat = 1 + nI + nS;
+    lastValid = false;
+    memset (lastLen, 0, sizeof (lastLen));
+}
+
+/**
+ *  \brief Writing a record, with the entity states equal to the previous record replaced by ".".
+ *
+ *  \param tp start of each field
+ *  \param tl length of each field
+ */
+static void putRecord (const char *tp[], int tl[])
+{
+    int f, len;
+
+    for (f = 0; f < nFields; f++) {
+        len = (tl[f] < TOKMAX) ? tl[f] : TOKMAX;
+        if ((f < nStat) && (len == lastLen[f]) && (memcmp (tp[f], last[f], (size_t) len) == 0)) {
+            putField (".", 1, width[f]);
+        }
+        else putField (tp[f], tl[f], width[f]);
+    }
+    for (f = 0; f < nFields; f++) {
+        lastLen[f] = (tl[f] < TOKMAX) ? tl[f] : TOKMAX;
+        memcpy (last[f], tp[f], (size_t) lastLen[f]);
+    }
+    putOut ("\n", 1);
+}
+
+/**
+ *  \brief Reading the number of ingredients and smokers from the column header.
+ *
+ *  \return \c true, if the fields are a column header
+ */
+static bool readHeader (const char *tp[], int tl[], int n)
+{
+    int f, nI = 0, nS = 0, nIn = 0, nC = 0;
+
+    if ((n < 1) || (tl[0] != 2) || (memcmp (tp[0], "AG", 2) != 0)) {
+        return false;
+    }
+    for (f = 1; f < n; f++) {
+        switch (tp[f][0]) {
+            case 'W': nI += 1; break;
+            case 'S': nS += 1; break;
+            case 'I': nIn += 1; break;
+            case 'C': nC += 1; break;
+            default:  return false;
+        }
+    }
+    if ((nI != nIn) || (nS != nC) || (nI > MAXENT) || (nS > MAXENT)) {
+        return false;
+    }
+    setLayout (nI, nS);
+    return true;
+}
+
+/**
+ *  \brief Expanding a delta record ("+ field=value ...") on top of the previous record.
+ *
+ *  \param line line to be expanded
+ *  \param len length of the line
+ *
+ *  \return \c true, if the line is a delta record
+ */
+static bool putDelta (const char *line, size_t len)
+{
+    const char *tp[MAXFIELDS];
+    int tl[MAXFIELDS];
+    char val[MAXFIELDS][TOKMAX];
+    const char *p = line + 1, *end = line + len, *q;
+    int f;
+
+    if (!lastValid) {
+        return false;
+    }
+    for (f = 0; f < nFields; f++) {
+        memcpy (val[f], last[f], (size_t) lastLen[f]);
+        tp[f] = val[f];
+        tl[f] = lastLen[f];
+    }
+    while (p < end) {
+        while ((p < end) && (*p == ' ')) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        for (f = 0; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+            f = 10 * f + (*p - '0');
+        }
+        if ((p == end) || (*p != '=') || (f >= nFields)) {
+            return false;
+        }
+        for (q = ++p; (q < end) && (*q != ' '); q++) {
+        }
+        if ((q == p) || (q - p > TOKMAX)) {
+            return false;
+        }
+        memcpy (val[f], p, (size_t) (q - p));
+        tl[f] = (int) (q - p);
+        p = q;
+    }
+    putRecord (tp, tl);
+    return true;
+}
+
+/**
+ *  \brief Filtering a line of a text log.
+ *
+ *  \param line line to be filtered
+ *  \param len length of the line (without the newline)
+ */
+static void filterLine (const char *line, size_t len)
+{
+    const char *tp[MAXFIELDS];
+    int tl[MAXFIELDS];
+    int n;
+
+    if ((len > 0) && (line[0] == '+') && (nFields > 0) && putDelta (line, len)) {
+        return;
+    }
+    n = splitFields (line, len, tp, tl);
+    if (nFields == 0) {
+        readHeader (tp, tl, n);
+    }
+    if ((nFields > 0) && (n == nFields)) {
+        putRecord (tp, tl);
+        lastValid = (tp[0][0] >= '0') && (tp[0][0] <= '9');
+        return;
+    }
+    putOut (line, len);
+    putOut ("\n", 1);
+}
+
+/**
+ *  \brief Filtering a text log, read in blocks.
+ *
+ *  \param fd descriptor of the log file
+ *  \param have number of bytes already read into the input buffer
+ */
+static void filterText (int fd, size_t have)
+{
+    size_t start = 0;
+    ssize_t n;
+    char *nl;
+
+    while (true) {
+        /* every complete line in the buffer */
+        while ((nl = memchr (inBuf + start, '\n', have - start)) != NULL) {
+            filterLine (inBuf + start, (size_t) (nl - (inBuf + start)));
+            start = (size_t) (nl - inBuf) + 1;
+        }
+        /* the incomplete line is moved to the front; a line longer than a block is cut */
+        if (have - start >= INSIZE) {
+            filterLine (inBuf + start, have - start);
+            start = have;
+        }
+        memmove (inBuf, inBuf + start, have - start);
+        have -= start;
+        start = 0;
+        if ((n = read (fd, inBuf + have, INSIZE)) == -1) {
+            perror ("error on reading log file");
+            exit (EXIT_FAILURE);
+        }
+        if (n == 0) {
+            break;
+        }
+        have += (size_t) n;
+    }
+    if (have > 0) {
+        filterLine (inBuf, have);
+    }
+}
+
+/**
+ *  \brief Reading a little endian integer of <tt>size</tt> bytes.
+ */
+static int64_t getBin (const unsigned char *p, int size, bool sign)
+{
+    uint64_t v = 0;
+    int k;
+
+    for (k = size - 1; k >= 0; k--) {
+        v = (v << 8) | p[k];
+    }
+    if (sign && (size < 8) && (v & (1ULL << (8 * size - 1)))) {
+        v |= ~0ULL << (8 * size);
+    }
+    return (int64_t) v;
+}
+
+/**
+ *  \brief Filtering a binary log, rendering its records as text.
+ *
+ *  The layout of each record is derived from the numbers of ingredients and smokers in the file header.
+ *
+ *  \param fd descriptor of the log file
+ *  \param have number of bytes already read into the input buffer
+ */
+static void filterBinary (int fd, size_t have)
+{
+    LOG_BIN_HEADER hdr;
+    char title[80];
+    char tok[MAXFIELDS][12];
+    const char *tp[MAXFIELDS];
+    int tl[MAXFIELDS];
+    size_t recSize, start, off;
+    ssize_t n;
+    int nI, nS, f, k;
+
+    while (have < sizeof (hdr)) {
+        if ((n = read (fd, inBuf + have, INSIZE)) <= 0) {
+            fprintf (stderr, "Binary log header is missing!\n");
+            exit (EXIT_FAILURE);
+        }
+        have += (size_t) n;
+    }
+    memcpy (&hdr, inBuf, sizeof (hdr));
+    nI = hdr.nIngredients;
+    nS = hdr.nSmokers;
+    recSize = 4 + 8 + 1 + 1 + (size_t) nI + (size_t) nS + 2 * (size_t) nI + 4 * (size_t) nS;
+    if ((hdr.version != LOG_BIN_VERSION) || (nI > MAXENT) || (nS > MAXENT) || (hdr.recSize != recSize)) {
+        fprintf (stderr, "Unsupported binary log (version %u, %d ingredients, %d smokers)!\n", hdr.version, nI, nS);
+        exit (EXIT_FAILURE);
+    }
+
+    /* the title and header written by createLog for a text log */
+    putOut (title, (size_t) snprintf (title, sizeof (title), "%21cSmokers - Description of the internal state\n\n", ' '));
+    setLayout (nI, nS);
+    f = 0;
+    tl[f] = sprintf (tok[f], "AG");
+    f++;
+    for (k = 0; k < nI; k++, f++) tl[f] = sprintf (tok[f], "W%02d", k);
+    for (k = 0; k < nS; k++, f++) tl[f] = sprintf (tok[f], "S%02d", k);
+    for (k = 0; k < nI; k++, f++) tl[f] = sprintf (tok[f], "I%02d", k);
+    for (k = 0; k < nS; k++, f++) tl[f] = sprintf (tok[f], "C%02d", k);
+    for (f = 0; f < nFields; f++) {
+        tp[f] = tok[f];
+    }
+    putRecord (tp, tl);
+
+    start = sizeof (hdr);
+    while (true) {
+        for (; have - start >= recSize; start += recSize) {
+            const unsigned char *r = (const unsigned char *) inBuf + start + 4 + 8 + 1;        /* agent state */
+
+            for (f = 0, off = 0; f < nStat; f++, off++) {
+                tl[f] = sprintf (tok[f], "%d", (int) r[off]);
+            }
+            for (k = 0; k < nI; k++, f++, off += 2) {
+                tl[f] = sprintf (tok[f], "%d", (int) getBin (r + off, 2, true));
+            }
+            for (k = 0; k < nS; k++, f++, off += 4) {
+                tl[f] = sprintf (tok[f], "%u", (unsigned int) getBin (r + off, 4, false));
+            }
+            putRecord (tp, tl);
+        }
+        memmove (inBuf, inBuf + start, have - start);
+        have -= start;
+        start = 0;
+        if ((n = read (fd, inBuf + have, INSIZE)) == -1) {
+            perror ("error on reading log file");
+            exit (EXIT_FAILURE);
+        }
+        if (n == 0) {
+            break;
+        }
+        have += (size_t) n;
+    }
+    if (have > 0) {
+        fprintf (stderr, "Binary log ends with an incomplete record!\n");
+    }
+}
+
+/**
+ *  \brief Main program.
+ *
+ *  Its role is telling text logs from binary ones and filtering them to stdout.
+ */
+int main (int argc, char *argv[])
+{
+    int fd = STDIN_FILENO;                                                                        /* log file */
+    ssize_t n;
+    size_t have = 0;
+
+    if (argc > 2) {
+        usage (argv[0]);
+    }
+    if ((argc == 2) && ((fd = open (argv[1], O_RDONLY)) == -1)) {
+        perror ("error on opening log file");
+        exit (EXIT_FAILURE);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    /* text logs start with the title line, binary logs with the magic number */
+    while (have < sizeof (LOG_BIN_MAGIC) - 1) {
+        if ((n = read (fd, inBuf + have, INSIZE)) == -1) {
+            perror ("error on reading log file");
+            exit (EXIT_FAILURE);
+        }
+        if (n == 0) {
+            break;
+        }
+        have += (size_t) n;
+    }
+    if ((have >= sizeof (LOG_BIN_MAGIC) - 1) && (memcmp (inBuf, LOG_BIN_MAGIC, sizeof (LOG_BIN_MAGIC) - 1) == 0)) {
+        filterBinary (fd, have);
+    }
+    else filterText (fd, have);
+    flushOut ();
+
+    return EXIT_SUCCESS;
+}
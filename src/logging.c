@@ -7,7 +7,12 @@
  *
  *  Defined operations:
  *     \li file initialization
- *     \li writing the present full state as a single line at the end of the file.
+ *     \li attachment of the calling process to the log
+ *     \li writing the present full state as a single line at the end of the file
+ *     \li flushing of the records buffered by the calling process
+ *     \li termination of the log
+ *     \li initialization, draining and closing of the ring of records written by the logger process
+ *     \li access to the fields of a record by their position in the line.
  *
  *  \author Nuno Lau - December 2019
  */
@@ -16,13 +21,121 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <linux/io_uring.h>
 
 
 #include "probConst.h"
 #include "probDataStruct.h"
+#include "logging.h"
+
+/** \brief maximum length of the name of the logging file */
+#define  LOG_NAMEMAX    256
+
+/** \brief upper bound on the length of a record (complete line) */
+#define  LOG_RECMAX     (12 * (1 + 2 * NUMINGREDIENTS + 2 * NUMSMOKERS) + 8)
+
+_Static_assert (sizeof (LOG_BIN_RECORD) <= LOG_RECMAX, "binary record does not fit the record buffer");
+
+/** \brief descriptor of the log file kept open (for appending) by the calling process */
+static int logFd = -1;
+
+/** \brief name of the logging file, reopened by the calling process when another one rotates the log */
+static char logName[LOG_NAMEMAX];
+
+/** \brief the log is rotated (the shared control block is then used on every write) */
+static bool logRotate = false;
+
+/** \brief segment of a rotated log the descriptor of the calling process refers to */
+static uint32_t logSegment = 0;
+
+/** \brief number of orders served (cigarettes smoked) in the last record formatted by the calling process */
+static int logOrders = 0;
+
+/** \brief shared mapping of the log file, with the LOG_SINK_MMAP sink */
+static char *logMap = NULL;
+
+/** \brief storage of the buffer of the calling process, with the LOG_SINK_WRITE sink */
+static char logMem[LOG_BUFSIZE];
+
+/** \brief buffer where the records of the calling process are accumulated */
+static char *logBuf = logMem;
+
+/** \brief io_uring instance of the calling process, with the LOG_SINK_URING sink */
+static int uringFd = -1;
+
+/** \brief pid of the process that set up the io_uring instance (a forked child must not use it) */
+static pid_t uringPid = -1;
+
+/** \brief submission queue ring (tail, mask and index array), mapped from the io_uring instance */
+static unsigned int *sqTail, *sqMask, *sqArray;
+
+/** \brief submission queue entries, mapped from the io_uring instance */
+static struct io_uring_sqe *sqes;
+
+/** \brief completion queue ring (head, tail and mask), mapped from the io_uring instance */
+static unsigned int *cqHead, *cqTail, *cqMask;
+
+/** \brief completion queue entries, mapped from the io_uring instance */
+static struct io_uring_cqe *cqes;
+
+/** \brief buffers handed to the kernel by the LOG_SINK_URING sink, one per write in flight */
+static char uringBuf[LOG_URING_DEPTH][LOG_BUFSIZE];
+
+/** \brief length of the write queued for each buffer */
+static size_t uringLen[LOG_URING_DEPTH];
+
+/** \brief buffer queued or in flight, and not yet reaped */
+static bool uringBusy[LOG_URING_DEPTH];
+
+/** \brief submission queue tail, published to the kernel on the next submit */
+static unsigned int uringTail;
+
+/** \brief last entry queued and not yet submitted (its link is cut on submit) */
+static struct io_uring_sqe *uringLast = NULL;
+
+/** \brief number of entries queued and not yet submitted */
+static unsigned int uringQueued = 0;
+
+/** \brief number of writes submitted and not yet reaped */
+static unsigned int uringInFlight = 0;
+
+/** \brief logging control block the calling process is attached to */
+static LOG_CTRL *logCtrl = NULL;
+
+/** \brief ring of records the calling process produces to (or drains, for the logger) */
+static LOG_RING *logRing = NULL;
+
+/** \brief log format of the calling process */
+static unsigned int logFormat = LOG_FMT_TEXT;
+
+/** \brief writer id of the calling process */
+static unsigned int logWriter = LOG_MAIN;
+
+/** \brief flush policy of the calling process */
+static unsigned int logFlush = LOG_FLUSH_RECORD;
+
+/** \brief number of records per batch of the calling process */
+static unsigned int logBatch = 1;
+
+/** \brief number of records buffered and not yet written */
+static unsigned int nPending = 0;
+
+/** \brief number of bytes buffered and not yet written */
+static size_t bPending = 0;
 
 /* internal functions */
 
@@ -60,6 +173,78 @@ static void closeLog(FILE *fic)
     }
 }
 
+static int openLogFd(char nFic[])
+{
+    int fd;
+
+    if ((nFic == NULL) || (strlen (nFic) == 0)) {
+        /* a private duplicate of stdout, so that each line is appended even if stdout was redirected */
+        if (((fd = dup (STDOUT_FILENO)) == -1) || (fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_APPEND) == -1)) {
+            perror ("error on opening log file");
+            exit (EXIT_FAILURE);
+        }
+        return fd;
+    }
+
+    fprintf(stderr,"%d opening log %s %s\n",getpid(),nFic,"a");
+
+    if ((fd = open (nFic, O_WRONLY | O_APPEND | O_CREAT, 0644)) == -1) {
+        perror ("error on opening log file");
+        exit (EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static void mapLog(char nFic[], uint64_t size)
+{
+    if ((nFic == NULL) || (strlen (nFic) == 0)) {
+        fprintf (stderr, "the mmap log sink requires a log file\n");
+        exit (EXIT_FAILURE);
+    }
+    if ((logFd = open (nFic, O_RDWR | O_CREAT, 0644)) == -1) {
+        perror ("error on opening log file");
+        exit (EXIT_FAILURE);
+    }
+    if ((logMap = mmap (NULL, (size_t) size, PROT_WRITE, MAP_SHARED, logFd, 0)) == MAP_FAILED) {
+        perror ("error on mapping the log file");
+        exit (EXIT_FAILURE);
+    }
+}
+
+static void writeLog(char *buf, size_t len)
+{
+    ssize_t n;
+
+    if (logMap != NULL) {
+        uint64_t off = __atomic_fetch_add (&logCtrl->mapOff, len, __ATOMIC_RELAXED);
+
+        if (off + len <= logCtrl->mapSize) {
+            memcpy (logMap + off, buf, len);
+            return;
+        }
+        /* preallocated space exhausted: the file grows past it */
+        while (len > 0) {
+            if ((n = pwrite (logFd, buf, len, (off_t) off)) == -1) {
+                perror ("error on writing to log file");
+                exit (EXIT_FAILURE);
+            }
+            buf += n;
+            off += (uint64_t) n;
+            len -= (size_t) n;
+        }
+        return;
+    }
+
+    while (len > 0) {
+        if ((n = write (logFd, buf, len)) == -1) {
+            perror ("error on writing to log file");
+            exit (EXIT_FAILURE);
+        }
+        buf += n;
+        len -= (size_t) n;
+    }
+}
+
 static void printHeader(FILE *fic, FULL_STAT *p_fSt)
 {
     fprintf(fic,"%3s","AG");
@@ -92,6 +277,590 @@ static void printHeader(FILE *fic, FULL_STAT *p_fSt)
     fprintf(fic,"\n");
 }
 
+/* writes the file header (title and column names, or a LOG_BIN_HEADER) */
+static void writeHeader(FILE *fic, FULL_STAT *p_fSt)
+{
+    if (logFormat == LOG_FMT_BINARY) {
+        LOG_BIN_HEADER hdr;                                                                  /* binary file header */
+
+        memcpy (hdr.magic, LOG_BIN_MAGIC, sizeof (hdr.magic));
+        hdr.version = LOG_BIN_VERSION;
+        hdr.nIngredients = (uint8_t) p_fSt->nIngredients;
+        hdr.nSmokers = (uint8_t) p_fSt->nSmokers;
+        hdr.recSize = (uint8_t) sizeof (LOG_BIN_RECORD);
+        hdr.start = logCtrl->start;
+        if (fwrite (&hdr, sizeof (hdr), 1, fic) != 1) {
+            perror ("error on writing to log file");
+            exit (EXIT_FAILURE);
+        }
+    }
+    else {
+        /* title line + blank line */
+
+        fprintf (fic, "%21cSmokers - Description of the internal state\n\n", ' ');
+        printHeader(fic, p_fSt);
+    }
+}
+
+/* appends the line of the current segment, stored in file fName, to the index of segments */
+static void indexLog(char fName[])
+{
+    char nIdx[LOG_NAMEMAX + 8];
+    FILE *fic;
+
+    snprintf (nIdx, sizeof (nIdx), "%s.idx", logName);
+    if ((fic = fopen (nIdx, "a")) == NULL) {
+        perror ("error on opening the index of log segments");
+        exit (EXIT_FAILURE);
+    }
+    fprintf (fic, "%u %llu %u %d %s\n", logCtrl->segment, (unsigned long long) logCtrl->segFirst,
+             logCtrl->segRecords, logCtrl->lastOrders, fName);
+    if (fclose (fic) == EOF) {
+        perror ("error on closing the index of log segments");
+        exit (EXIT_FAILURE);
+    }
+}
+
+/* compresses the segments whose names are read from fd, each in a process of its own, until every process that
+   may rotate the log has terminated */
+static void runZip(int fd, unsigned int zip)
+{
+    char seg[LOG_NAMEMAX + 16];
+    ssize_t n;
+
+    signal (SIGCHLD, SIG_IGN);                                   /* the compressors are reaped by the kernel */
+    setpriority (PRIO_PROCESS, 0, 10);
+    while ((n = recv (fd, seg, sizeof (seg) - 1, 0)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        seg[n] = '\0';
+        if (fork () == 0) {
+            if (zip == LOG_ZIP_ZSTD) {
+                execlp ("zstd", "zstd", "-q", "-f", "--rm", seg, (char *) NULL);
+            }
+            else execlp ("gzip", "gzip", "-f", seg, (char *) NULL);
+            perror ("error on executing the log compressor");
+            _exit (EXIT_FAILURE);
+        }
+    }
+    _exit (EXIT_SUCCESS);
+}
+
+/* starts the process that compresses the completed segments, adopted by init, so that the processes that rotate
+   the log only hand it the name of each segment and never fork themselves */
+static void startZip(void)
+{
+    int sv[2];                                              /* socket pair: the compressor reads from sv[0] */
+    pid_t pid;
+
+    if (socketpair (AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+        perror ("error on creating the socket of the log compressor");
+        exit (EXIT_FAILURE);
+    }
+    fcntl (sv[0], F_SETFD, FD_CLOEXEC);
+    if ((pid = fork ()) == -1) {
+        perror ("error on the fork operation for the log compressor");
+        exit (EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        /* the intermediate process exits at once, so the compressor is adopted by init; sv[1] is inherited by
+           every process that may rotate the log, and the compressor reads the end of the stream once they all exit */
+        if (fork () == 0) {
+            close (sv[1]);
+            runZip (sv[0], logCtrl->zip);
+        }
+        _exit (EXIT_SUCCESS);
+    }
+    waitpid (pid, NULL, 0);
+    close (sv[0]);
+    logCtrl->zipFd = sv[1];
+}
+
+/* reopens the log file once it was rotated, on the write path, so without tracing it as openLogFd does */
+static void reopenLog(void)
+{
+    close (logFd);
+    if ((logFd = open (logName, O_WRONLY | O_APPEND | O_CREAT, 0644)) == -1) {
+        perror ("error on opening log file");
+        exit (EXIT_FAILURE);
+    }
+    logSegment = logCtrl->segment;
+}
+
+/* closes the current segment and starts the next one; called with rotLock held */
+static void rotateLog(void)
+{
+    char seg[LOG_NAMEMAX + 16], zSeg[LOG_NAMEMAX + 24];
+    FULL_STAT fSt;
+    FILE *fic;
+
+    snprintf (seg, sizeof (seg), "%s.%u", logName, logCtrl->segment);
+    snprintf (zSeg, sizeof (zSeg), "%s%s", seg,
+              (logCtrl->zip == LOG_ZIP_GZIP) ? ".gz" : (logCtrl->zip == LOG_ZIP_ZSTD) ? ".zst" : "");
+    if (rename (logName, seg) == -1) {
+        perror ("error on renaming a log segment");
+        exit (EXIT_FAILURE);
+    }
+    indexLog (zSeg);
+    logCtrl->segment += 1;
+    logCtrl->segFirst += logCtrl->segRecords;
+    logCtrl->segRecords = 0;
+    logCtrl->lastValid = false;                                  /* a delta segment starts with a full record */
+
+    /* each segment has its own header, so that it can be read on its own */
+    memset (&fSt, 0, sizeof (fSt));
+    fSt.nIngredients = NUMINGREDIENTS;
+    fSt.nSmokers = NUMSMOKERS;
+    if ((fic = fopen (logName, "w")) == NULL) {
+        perror ("error on opening log file");
+        exit (EXIT_FAILURE);
+    }
+    writeHeader (fic, &fSt);
+    fflush (fic);
+    logCtrl->segBytes = (uint64_t) ftell (fic);
+    closeLog (fic);
+    reopenLog ();
+
+    /* the name goes out in a single message, which the compressor reads whole */
+    if ((logCtrl->zip != LOG_ZIP_NONE) && (send (logCtrl->zipFd, seg, strlen (seg), MSG_NOSIGNAL) == -1)) {
+        perror ("error on handing a log segment to the compressor");
+        exit (EXIT_FAILURE);
+    }
+}
+
+/* writes nRec records, rotating the log when they fill the current segment */
+static void appendLog(char *buf, size_t len, unsigned int nRec)
+{
+    if (!logRotate) {
+        writeLog (buf, len);
+        return;
+    }
+
+    while (__atomic_exchange_n (&logCtrl->rotLock, 1, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield ();
+    }
+    if (logSegment != logCtrl->segment) {                               /* the log was rotated by another process */
+        reopenLog ();
+    }
+    writeLog (buf, len);
+    logCtrl->segBytes += len;
+    logCtrl->segRecords += nRec;
+    logCtrl->lastOrders = logOrders;
+    if (((logCtrl->rotBytes > 0) && (logCtrl->segBytes >= logCtrl->rotBytes)) ||
+        ((logCtrl->rotRecords > 0) && (logCtrl->segRecords >= logCtrl->rotRecords))) {
+        rotateLog ();
+    }
+    __atomic_store_n (&logCtrl->rotLock, 0, __ATOMIC_RELEASE);
+}
+
+/* sets up the io_uring instance and maps its rings; false if the kernel does not provide what is needed */
+static bool openUring(void)
+{
+    struct io_uring_params p;
+    char *sq, *cq;
+    size_t sqLen, cqLen;
+
+    /* completions are only processed when this process asks for them: otherwise, the kernel would notify it
+       as if a signal had arrived and its blocking semaphore operations would fail with EINTR */
+    memset (&p, 0, sizeof (p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    if ((uringFd = (int) syscall (__NR_io_uring_setup, LOG_URING_DEPTH, &p)) == -1) {
+        return false;
+    }
+    /* writes at the current position (offset -1) are needed for appending and for pipes */
+    if (!(p.features & IORING_FEAT_RW_CUR_POS) || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close (uringFd);
+        uringFd = -1;
+        return false;
+    }
+    fcntl (uringFd, F_SETFD, FD_CLOEXEC);
+
+    sqLen = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+    cqLen = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    if (cqLen > sqLen) {
+        sqLen = cqLen;
+    }
+    if ((sq = mmap (NULL, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uringFd,
+                    IORING_OFF_SQ_RING)) == MAP_FAILED) {
+        perror ("error on mapping the io_uring rings");
+        exit (EXIT_FAILURE);
+    }
+    if ((sqes = mmap (NULL, p.sq_entries * sizeof (struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, uringFd, IORING_OFF_SQES)) == MAP_FAILED) {
+        perror ("error on mapping the io_uring submission entries");
+        exit (EXIT_FAILURE);
+    }
+    cq = sq;
+    sqTail = (unsigned int *) (sq + p.sq_off.tail);
+    sqMask = (unsigned int *) (sq + p.sq_off.ring_mask);
+    sqArray = (unsigned int *) (sq + p.sq_off.array);
+    cqHead = (unsigned int *) (cq + p.cq_off.head);
+    cqTail = (unsigned int *) (cq + p.cq_off.tail);
+    cqMask = (unsigned int *) (cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    uringTail = *sqTail;
+    uringPid = getpid ();
+    logBuf = uringBuf[0];
+    return true;
+}
+
+/* hands every queued entry to the kernel, without waiting for their completion */
+static void submitUring(void)
+{
+    int n;
+
+    if (uringQueued == 0) {
+        return;
+    }
+    uringLast->flags &= (uint8_t) ~IOSQE_IO_LINK;                                   /* the chain ends here */
+    __atomic_store_n (sqTail, uringTail, __ATOMIC_RELEASE);
+    while (uringQueued > 0) {
+        if ((n = (int) syscall (__NR_io_uring_enter, uringFd, uringQueued, 0, 0, NULL, 0)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror ("error on submitting writes to the log file");
+            exit (EXIT_FAILURE);
+        }
+        uringQueued -= (unsigned int) n;
+        uringInFlight += (unsigned int) n;
+    }
+    uringLast = NULL;
+}
+
+/* reaps the completed writes, waiting until no more than maxInFlight remain */
+static void reapUring(unsigned int maxInFlight)
+{
+    unsigned int head = *cqHead;
+    struct io_uring_cqe *cqe;
+    size_t done;
+    unsigned int wait = 0;                                         /* completions to wait for in the next enter */
+
+    while (true) {
+        /* deferred completions are only posted to the queue on entering the kernel */
+        if ((uringInFlight > 0) &&
+            (syscall (__NR_io_uring_enter, uringFd, 0, wait, IORING_ENTER_GETEVENTS, NULL, 0) == -1) &&
+            (errno != EINTR)) {
+            perror ("error on waiting for writes to the log file");
+            exit (EXIT_FAILURE);
+        }
+        while (head != __atomic_load_n (cqTail, __ATOMIC_ACQUIRE)) {
+            cqe = &cqes[head & *cqMask];
+            done = (cqe->res > 0) ? (size_t) cqe->res : 0;
+            if ((cqe->res < 0) && (cqe->res != -ECANCELED)) {
+                errno = -cqe->res;
+                perror ("error on writing to log file");
+                exit (EXIT_FAILURE);
+            }
+            /* a short write cancels the rest of its chain: what is missing is written synchronously, in order */
+            if (done < uringLen[cqe->user_data]) {
+                writeLog (uringBuf[cqe->user_data] + done, uringLen[cqe->user_data] - done);
+            }
+            uringBusy[cqe->user_data] = false;
+            uringInFlight -= 1;
+            head += 1;
+        }
+        __atomic_store_n (cqHead, head, __ATOMIC_RELEASE);
+        if (uringInFlight <= maxInFlight) {
+            return;
+        }
+        wait = 1;
+    }
+}
+
+/* queues a write of the buffered records, linked to the previous queued one, and moves on to a free buffer */
+static void queueUring(void)
+{
+    unsigned int idx = uringTail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    unsigned int b = (unsigned int) ((logBuf - uringBuf[0]) / LOG_BUFSIZE);
+
+    memset (sqe, 0, sizeof (*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = logFd;
+    sqe->addr = (uint64_t) (uintptr_t) logBuf;
+    sqe->len = (uint32_t) bPending;
+    sqe->off = (uint64_t) -1;                                                  /* current position (appending) */
+    sqe->user_data = b;
+    sqe->flags = IOSQE_IO_LINK;
+    if ((uringQueued == 0) && (uringInFlight > 0)) {
+        sqe->flags |= IOSQE_IO_DRAIN;                          /* a new chain only starts after the previous ones */
+    }
+    sqArray[idx] = idx;
+    uringTail += 1;
+    uringQueued += 1;
+    uringLast = sqe;
+    uringLen[b] = bPending;
+    uringBusy[b] = true;
+    nPending = 0;
+    bPending = 0;
+
+    /* completions are only reaped here, when a buffer is needed, and without waiting if one is free */
+    reapUring (LOG_URING_DEPTH);
+    while (true) {
+        for (b = 0; b < LOG_URING_DEPTH; b++) {
+            if (!uringBusy[b]) {
+                logBuf = uringBuf[b];
+                return;
+            }
+        }
+        submitUring ();
+        reapUring (uringInFlight - 1);
+    }
+}
+
+/* writes (or submits, with the LOG_SINK_URING sink) the records buffered by the calling process */
+static void writeBuf(void)
+{
+    if (uringFd != -1) {
+        if (nPending > 0) {
+            queueUring ();
+        }
+        submitUring ();
+        return;
+    }
+    if (nPending > 0) {
+        appendLog (logBuf, bPending, nPending);
+        nPending = 0;
+        bPending = 0;
+    }
+}
+
+/* writes what is still buffered on process termination */
+static void exitLog(void)
+{
+    if ((uringFd != -1) && (uringPid != getpid ())) {
+        return;                                          /* a forked child that failed to execute its program */
+    }
+    flushLog ();
+}
+
+/* right aligned decimal conversion of val in a field of (at least) width characters, like "%*d" */
+static char *putInt(char *p, int val, int width)
+{
+    char digits[12];
+    unsigned int u = (val < 0) ? -(unsigned int) val : (unsigned int) val;
+    int n = 0;
+
+    do {
+        digits[n++] = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (val < 0) {
+        digits[n++] = '-';
+    }
+    while (width-- > n) {
+        *p++ = ' ';
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+/* renders the full state line into buf, which must hold LOG_RECMAX characters; returns its length */
+static size_t formatState(char *buf, FULL_STAT *p_fSt)
+{
+    char *p = buf;
+
+    p = putInt(p, (int) SLOT (p_fSt->st.agentStat), 3);
+    *p++ = ' ';
+    int w;
+    for(w=0; w < p_fSt->nIngredients; w++) {
+        p = putInt(p, (int) SLOT (p_fSt->st.watcherStat[w]), 4);
+    }
+
+    *p++ = ' ';
+
+    int s;
+    for(s=0; s < p_fSt->nSmokers; s++) {
+        p = putInt(p, (int) SLOT (p_fSt->st.smokerStat[s]), 4);
+    }
+
+    *p++ = ' ';
+
+    int i;
+    for(i=0; i < p_fSt->nIngredients; i++) {
+        p = putInt(p, SLOT (p_fSt->ingredients[i]), 4);
+    }
+
+    *p++ = ' ';
+
+    for(s=0; s < p_fSt->nSmokers; s++) {
+        p = putInt(p, SLOT (p_fSt->nCigarettes[s]), 4);
+    }
+
+    *p++ = '\n';
+
+    return (size_t) (p - buf);
+}
+
+/* renders only the fields that changed since the last delta record; the first one is rendered in full */
+static size_t formatDelta(char *buf, FULL_STAT *p_fSt)
+{
+    char *p = buf;
+    unsigned int f;
+    int v;
+
+    if (!logCtrl->lastValid) {
+        for (f = 0; f < LOG_NFIELDS; f++) {
+            logCtrl->last[f] = getLogField (p_fSt, f);
+        }
+        logCtrl->lastValid = true;
+        return formatState (buf, p_fSt);
+    }
+
+    *p++ = '+';
+    for (f = 0; f < LOG_NFIELDS; f++) {
+        if ((v = getLogField (p_fSt, f)) != logCtrl->last[f]) {
+            *p++ = ' ';
+            p = putInt (p, (int) f, 0);
+            *p++ = '=';
+            p = putInt (p, v, 0);
+            logCtrl->last[f] = v;
+        }
+    }
+    *p++ = '\n';
+
+    return (size_t) (p - buf);
+}
+
+static uint64_t clockNs(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime (clk, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+/* packs the full state into a binary record at buf; returns its length */
+static size_t formatRecord(char *buf, FULL_STAT *p_fSt, uint32_t seq, uint64_t time, unsigned int writer)
+{
+    LOG_BIN_RECORD rec;
+    int w, s, i;
+
+    rec.seq = seq;
+    rec.time = time;
+    rec.writer = (uint8_t) writer;
+    rec.agentStat = (uint8_t) SLOT (p_fSt->st.agentStat);
+    for(w=0; w < NUMINGREDIENTS; w++) {
+        rec.watcherStat[w] = (uint8_t) SLOT (p_fSt->st.watcherStat[w]);
+    }
+    for(s=0; s < NUMSMOKERS; s++) {
+        rec.smokerStat[s] = (uint8_t) SLOT (p_fSt->st.smokerStat[s]);
+        rec.nCigarettes[s] = (uint32_t) SLOT (p_fSt->nCigarettes[s]);
+    }
+    for(i=0; i < NUMINGREDIENTS; i++) {
+        rec.ingredients[i] = (int16_t) SLOT (p_fSt->ingredients[i]);
+    }
+
+    memcpy (buf, &rec, sizeof (rec));
+    return sizeof (rec);
+}
+
+/* formats one record and writes it, or buffers it, according to the flush policy */
+static void emitState(FULL_STAT *p_fSt, uint32_t seq, uint64_t time, unsigned int writer)
+{
+    char line[LOG_RECMAX];                                                                  /* record being built */
+    size_t n;                                                                                   /* record length */
+    int s, orders = 0;                                                             /* cigarettes smoked so far */
+
+    if (logFormat == LOG_FMT_BINARY) {
+        n = formatRecord (line, p_fSt, seq, time, writer);
+    }
+    else if (logFormat == LOG_FMT_DELTA) {
+        n = formatDelta (line, p_fSt);
+    }
+    else n = formatState (line, p_fSt);
+    for (s = 0; s < NUMSMOKERS; s++) {
+        orders += SLOT (p_fSt->nCigarettes[s]);
+    }
+
+    /* the whole record goes out in a single write, so that records of different processes never interleave */
+    if (((logFlush == LOG_FLUSH_RECORD) && (nPending == 0) && (uringFd == -1)) || (logMap != NULL)) {
+        logOrders = orders;
+        appendLog (line, n, 1);
+        return;
+    }
+
+    if (bPending + n > LOG_BUFSIZE) {
+        if (uringFd != -1) {
+            queueUring ();                                   /* submitted along with the next ones, as a chain */
+        }
+        else writeBuf ();
+    }
+    logOrders = orders;
+    memcpy (logBuf + bPending, line, n);
+    nPending += 1;
+    bPending += n;
+
+    if ((logFlush == LOG_FLUSH_RECORD) || ((logFlush == LOG_FLUSH_BATCH) && (nPending >= logBatch))) {
+        writeBuf ();
+    }
+}
+
+/* decides without locking whether a record may be due, according to the log level: a periodic snapshot is claimed
+   here, while a transition is only told for sure by keepRecord */
+static bool dueRecord(FULL_STAT *p_fSt)
+{
+    uint64_t now, next;
+
+    switch (logCtrl->level) {
+        case LOG_LEVEL_OFF:
+            return false;
+        case LOG_LEVEL_PERIODIC:
+            now = clockNs (CLOCK_MONOTONIC);
+            next = __atomic_load_n (&logCtrl->nextSnap, __ATOMIC_RELAXED);
+            do {
+                if (now < next) {
+                    return false;
+                }
+            } while (!__atomic_compare_exchange_n (&logCtrl->nextSnap, &next,
+                                                   now + (uint64_t) logCtrl->period * 1000000, false,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+            return true;
+        case LOG_LEVEL_TRANS:
+            /* the last state kept by the logger lags behind the ring, so it only filters the records of the ring */
+            return (logRing != NULL) || !logCtrl->lastStValid ||
+                   (memcmp (&logCtrl->lastSt, &p_fSt->st, sizeof (STAT)) != 0);
+        default:
+            return true;
+    }
+}
+
+/* decides whether a record shows a transition of some entity (LOG_LEVEL_TRANS); called with the log lock held,
+   or by the logger for the records of the ring */
+static bool keepRecord(FULL_STAT *p_fSt)
+{
+    if (logCtrl->lastStValid && (memcmp (&logCtrl->lastSt, &p_fSt->st, sizeof (STAT)) == 0)) {
+        return false;
+    }
+    logCtrl->lastSt = p_fSt->st;
+    logCtrl->lastStValid = true;
+    return true;
+}
+
+/* queues a consistent snapshot of the full state in the ring, without locking: the ticket orders the records, and
+   only waits if the logger fell a whole ring behind */
+static void pushRing(FULL_STAT *p_fSt)
+{
+    uint32_t t = __atomic_fetch_add (&logRing->head, 1, __ATOMIC_RELAXED);
+    LOG_SLOT *slot = &logRing->slot[t % LOG_RING_SIZE];
+
+    while (__atomic_load_n (&slot->turn, __ATOMIC_ACQUIRE) != t) {
+        sched_yield ();
+    }
+    readState (logCtrl, p_fSt, &slot->fSt);
+    slot->writer = logWriter;
+    slot->time = clockNs (CLOCK_MONOTONIC) - logCtrl->t0;
+    __atomic_store_n (&slot->turn, t + 1, __ATOMIC_RELEASE);
+}
+
 /* external functions */
 
 /**
@@ -104,6 +873,11 @@ static void printHeader(FILE *fic, FULL_STAT *p_fSt)
  *       \li a title line
  *       \li a blank line.
  *
+ *  When the calling process is attached to the log in LOG_FMT_BINARY format, a LOG_BIN_HEADER is written instead.
+ *  In LOG_FMT_DELTA format, the first record that follows is written in full.
+ *  When rotation is enabled, the index of segments (<tt>nFic</tt> followed by ".idx") is created as well, and so
+ *  is the process that compresses the completed segments, unless <tt>zip</tt> is LOG_ZIP_NONE.
+ *
  *  \param nFic name of the logging file
  */
 void createLog (char nFic[], FULL_STAT *p_fSt)
@@ -112,18 +886,175 @@ void createLog (char nFic[], FULL_STAT *p_fSt)
 
     fic = openLog(nFic,"w");
 
-    /* title line + blank line */
+    if (logFormat == LOG_FMT_BINARY) {
+        logCtrl->start = clockNs (CLOCK_REALTIME);
+        logCtrl->t0 = clockNs (CLOCK_MONOTONIC);
+        logCtrl->seq = 0;
+    }
+    writeHeader (fic, p_fSt);
+
+    if (logCtrl != NULL) {
+        logCtrl->lastValid = false;
+        logCtrl->lastStValid = false;
+        logCtrl->nextSnap = 0;
+    }
 
-    fprintf (fic, "%21cSmokers - Description of the internal state\n\n", ' ');
-    printHeader(fic, p_fSt);
+    /* the first segment of a rotated log starts with a fresh index */
+    if ((logCtrl != NULL) && ((logCtrl->rotBytes > 0) || (logCtrl->rotRecords > 0))) {
+        char nIdx[LOG_NAMEMAX + 8];
+        FILE *idx;
+
+        snprintf (nIdx, sizeof (nIdx), "%s.idx", nFic);
+        if ((idx = fopen (nIdx, "w")) == NULL) {
+            perror ("error on creating the index of log segments");
+            exit (EXIT_FAILURE);
+        }
+        fprintf (idx, "# segment first-record records orders file\n");
+        fclose (idx);
+        fflush (fic);
+        logCtrl->segment = 1;
+        logCtrl->segBytes = (uint64_t) ftell (fic);
+        logCtrl->segRecords = 0;
+        logCtrl->segFirst = 0;
+        logCtrl->lastOrders = 0;
+        logSegment = 1;
+        if (logCtrl->zip != LOG_ZIP_NONE) {
+            startZip ();
+        }
+    }
+
+    /* records are copied right after the header, into space reserved now */
+    if (logMap != NULL) {
+        fflush (fic);
+        logCtrl->mapOff = (uint64_t) ftell (fic);
+        if ((errno = posix_fallocate (logFd, 0, (off_t) logCtrl->mapSize)) != 0) {
+            perror ("error on preallocating the log file");
+            exit (EXIT_FAILURE);
+        }
+    }
 
     closeLog(fic);
 }
 
+/**
+ *  \brief Attachment of the calling process to the log.
+ *
+ *  The logging file is opened for appending once and stays open until the process terminates.
+ *  Records are formatted into a per-process buffer and written to the file according to the
+ *  flush policy stored in <tt>p_lc</tt>. Any records still buffered are written on process termination.
+ *  If <tt>nFic</tt> is a null pointer or a null string, stdout is used.
+ *
+ *  When the ring is enabled in <tt>p_lc</tt>, records are queued in <tt>p_ring</tt> instead, except for the
+ *  logger process, which drains them.
+ *  With the LOG_SINK_URING sink, the buffers are submitted as asynchronous writes; if io_uring is not available,
+ *  the LOG_SINK_WRITE sink is used instead.
+ *  When rotation is enabled, the write that fills the current segment starts the next one, and the completed
+ *  segment is handed to the compressor process started by createLog.
+ *
+ *  \param nFic name of the logging file
+ *  \param p_lc pointer to the logging control block
+ *  \param p_ring pointer to the ring of records (may be null when the ring is not enabled)
+ *  \param writer id of the calling process
+ */
+void logAttach (char nFic[], LOG_CTRL *p_lc, LOG_RING *p_ring, unsigned int writer)
+{
+    if (logFd != -1) {
+        flushLog ();
+    }
+    else {
+        if ((p_lc != NULL) && (p_lc->sink == LOG_SINK_MMAP)) {
+            mapLog (nFic, p_lc->mapSize);
+        }
+        else logFd = openLogFd (nFic);
+        snprintf (logName, sizeof (logName), "%s", (nFic != NULL) ? nFic : "");
+        if (p_lc != NULL) {
+            logSegment = p_lc->segment;
+        }
+        if ((p_lc != NULL) && (p_lc->sink == LOG_SINK_URING) && !openUring ()) {
+            fprintf (stderr, "%d io_uring is not available, falling back to write()\n", getpid ());
+        }
+        atexit (exitLog);
+    }
+
+    logCtrl = p_lc;
+    logWriter = writer;
+    logRing = NULL;
+    if (p_lc != NULL) {
+        logFlush = p_lc->flush;
+        logBatch = (p_lc->batch > 0) ? p_lc->batch : 1;
+        logFormat = p_lc->format;
+        logRotate = (p_lc->rotBytes > 0) || (p_lc->rotRecords > 0);
+        if (p_lc->ring) {
+            logRing = p_ring;
+        }
+    }
+}
+
+/**
+ *  \brief Getting a field of the full state by its position in a text record.
+ *
+ *  \param p_fSt pointer to the full state
+ *  \param f field position (0 .. LOG_NFIELDS-1)
+ *
+ *  \return value of the field
+ */
+int getLogField (FULL_STAT *p_fSt, unsigned int f)
+{
+    if (f == 0) {
+        return (int) SLOT (p_fSt->st.agentStat);
+    }
+    f -= 1;
+    if (f < NUMINGREDIENTS) {
+        return (int) SLOT (p_fSt->st.watcherStat[f]);
+    }
+    f -= NUMINGREDIENTS;
+    if (f < NUMSMOKERS) {
+        return (int) SLOT (p_fSt->st.smokerStat[f]);
+    }
+    f -= NUMSMOKERS;
+    if (f < NUMINGREDIENTS) {
+        return SLOT (p_fSt->ingredients[f]);
+    }
+    return SLOT (p_fSt->nCigarettes[f - NUMINGREDIENTS]);
+}
+
+/**
+ *  \brief Setting a field of the full state by its position in a text record.
+ *
+ *  \param p_fSt pointer to the full state
+ *  \param f field position (0 .. LOG_NFIELDS-1)
+ *  \param val new value of the field
+ */
+void setLogField (FULL_STAT *p_fSt, unsigned int f, int val)
+{
+    if (f == 0) {
+        SLOT (p_fSt->st.agentStat) = (unsigned int) val;
+        return;
+    }
+    f -= 1;
+    if (f < NUMINGREDIENTS) {
+        SLOT (p_fSt->st.watcherStat[f]) = (unsigned int) val;
+        return;
+    }
+    f -= NUMINGREDIENTS;
+    if (f < NUMSMOKERS) {
+        SLOT (p_fSt->st.smokerStat[f]) = (unsigned int) val;
+        return;
+    }
+    f -= NUMSMOKERS;
+    if (f < NUMINGREDIENTS) {
+        SLOT (p_fSt->ingredients[f]) = val;
+        return;
+    }
+    SLOT (p_fSt->nCigarettes[f - NUMINGREDIENTS]) = val;
+}
+
 /**
  *  \brief Writing the present full state as a single line at the end of the file.
  *
- *  If <tt>nFic</tt> is a null pointer or a null string, the lines are written to stdout
+ *  If <tt>nFic</tt> is a null pointer or a null string, the lines are written to stdout.
+ *  If the calling process is not yet attached to the log, it is attached with the LOG_FLUSH_RECORD policy.
+ *  Records not selected by the log level are discarded.
  *
  *  The following layout is obeyed for the full state in a single line
  *    \li agent state
@@ -135,41 +1066,236 @@ void createLog (char nFic[], FULL_STAT *p_fSt)
  *  \param nFic name of the logging file
  *  \param p_fSt pointer to the location where the full internal state of the problem is stored
  */
-void saveState (char nFic[], FULL_STAT *p_fSt)
+void (saveState) (char nFic[], FULL_STAT *p_fSt)
 {
-    FILE *fic;                                                                                      /* file descriptor */
+    FULL_STAT snap;                                                      /* consistent copy of the full state */
 
-    fic = openLog(nFic,"a");
+    if (logFd == -1) {
+        logAttach (nFic, NULL, NULL, LOG_MAIN);
+    }
 
-    fprintf(fic,"%3d",p_fSt->st.agentStat);
-    fprintf(fic," ");
-    int w;
-    for(w=0; w < p_fSt->nIngredients; w++) {
-        fprintf(fic,"%4d",p_fSt->st.watcherStat[w]);
+    if (logCtrl == NULL) {
+        emitState (p_fSt, 0, 0, logWriter);
+        return;
+    }
+    /* the log is only locked when a record is actually written */
+    if (!dueRecord (p_fSt)) {
+        return;
+    }
+    if ((logRing != NULL) && (logWriter != LOG_LOGGER)) {
+        pushRing (p_fSt);                                         /* the logger tells the transitions apart */
+        return;
     }
+    lockLog ();
+    readState (logCtrl, p_fSt, &snap);
+    if ((logCtrl->level != LOG_LEVEL_TRANS) || keepRecord (&snap)) {
+        if (logFormat == LOG_FMT_BINARY) {
+            emitState (&snap, __atomic_fetch_add (&logCtrl->seq, 1, __ATOMIC_RELAXED),
+                       clockNs (CLOCK_MONOTONIC) - logCtrl->t0, logWriter);
+        }
+        else emitState (&snap, 0, 0, logWriter);
+    }
+    unlockLog ();
+}
 
-    fprintf(fic," ");
+/**
+ *  \brief Locking of the log.
+ *
+ *  saveState holds a spinlock shared by all processes while it takes a snapshot of the full state and writes it,
+ *  so records appear in the order their snapshots were taken. It is only taken when a record is written: the
+ *  updates of the full state need no lock, since saveState copies the state consistently (see readState).
+ *  The lock is taken inside the critical region of the mutex, never the other way around.
+ */
+void (lockLog) (void)
+{
+    if (logCtrl == NULL) {
+        return;
+    }
+    while (__atomic_exchange_n (&logCtrl->stLock, 1, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield ();
+    }
+}
 
-    int s;
-    for(s=0; s < p_fSt->nSmokers; s++) {
-        fprintf(fic,"%4d",p_fSt->st.smokerStat[s]);
+/**
+ *  \brief Unlocking of the log (see lockLog).
+ */
+void (unlockLog) (void)
+{
+    if (logCtrl == NULL) {
+        return;
     }
+    __atomic_store_n (&logCtrl->stLock, 0, __ATOMIC_RELEASE);
+}
 
-    fprintf(fic," ");
+/**
+ *  \brief Start of an update of the full state by the calling process.
+ *
+ *  The sequence number of the calling process is made odd before any field is written, so that readers which
+ *  take no lock (readState) can tell a torn copy. Each process only writes its own sequence number, in a cache
+ *  line of its own, so the updates of different processes are neither serialized nor contend for a line.
+ */
+void beginUpdate (void)
+{
+    uint32_t *seq;
 
-    int i;
-    for(i=0; i < p_fSt->nIngredients; i++) {
-        fprintf(fic,"%4d",p_fSt->ingredients[i]);
+    if ((logCtrl == NULL) || (logWriter >= LOG_LOGGER)) {
+        return;
     }
+    seq = &logCtrl->stSeq[logWriter].val;
+    __atomic_store_n (seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);                    /* the updates follow the odd sequence number */
+}
 
-    fprintf(fic," ");
+/**
+ *  \brief End of an update of the full state by the calling process (see beginUpdate).
+ */
+void endUpdate (void)
+{
+    uint32_t *seq;
 
-    for(s=0; s < p_fSt->nSmokers; s++) {
-        fprintf(fic,"%4d",p_fSt->nCigarettes[s]);
+    if ((logCtrl == NULL) || (logWriter >= LOG_LOGGER)) {
+        return;
     }
+    seq = &logCtrl->stSeq[logWriter].val;
+    __atomic_store_n (seq, *seq + 1, __ATOMIC_RELEASE);
+}
 
-    fprintf(fic,"\n");
+/**
+ *  \brief Reading of a snapshot of the full state without locking.
+ *
+ *  The sequence numbers of all writers are read, waiting while any is odd, then the full state is copied and the
+ *  numbers are read again: if some changed, an update happened during the copy and it is taken again.
+ *
+ *  \param p_lc pointer to the logging control block holding the sequence numbers
+ *  \param p_fSt pointer to the full state
+ *  \param snap where the snapshot is stored
+ *
+ *  \return number of copies discarded because they were torn
+ */
+unsigned int readState (LOG_CTRL *p_lc, FULL_STAT *p_fSt, FULL_STAT *snap)
+{
+    uint32_t before[LOG_LOGGER];                                         /* sequence numbers before the copy */
+    unsigned int w, torn = 0;
 
-    closeLog(fic);
+    while (true) {
+        for (w = 0; w < LOG_LOGGER; w++) {
+            while ((before[w] = __atomic_load_n (&p_lc->stSeq[w].val, __ATOMIC_ACQUIRE)) & 1) {
+                sched_yield ();                                                      /* an update is in progress */
+            }
+        }
+        memcpy (snap, p_fSt, sizeof (FULL_STAT));
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);                        /* the copy precedes the second reading */
+        for (w = 0; w < LOG_LOGGER; w++) {
+            if (__atomic_load_n (&p_lc->stSeq[w].val, __ATOMIC_RELAXED) != before[w]) {
+                break;
+            }
+        }
+        if (w == LOG_LOGGER) {
+            return torn;
+        }
+        torn += 1;
+    }
+}
+
+/**
+ *  \brief Writing to the file all the records buffered by the calling process.
+ *
+ *  With the LOG_SINK_URING sink, it only returns once every write submitted by the calling process completed.
+ */
+void flushLog (void)
+{
+    if (logFd == -1) {
+        return;
+    }
+
+    writeBuf ();
+    if (uringFd != -1) {
+        reapUring (0);
+    }
+}
+
+/**
+ *  \brief Termination of the log.
+ *
+ *  Records buffered by the calling process are written. With the LOG_SINK_MMAP sink, the file is truncated to the
+ *  length actually used, so it must only be called once every other process stopped writing.
+ *  When rotation is enabled, the last segment is recorded in the index.
+ */
+void endLog (void)
+{
+    flushLog ();
+
+    if (logRotate) {
+        indexLog (logName);
+    }
+
+    if (logMap != NULL) {
+        if (ftruncate (logFd, (off_t) __atomic_load_n (&logCtrl->mapOff, __ATOMIC_RELAXED)) == -1) {
+            perror ("error on truncating the log file");
+            exit (EXIT_FAILURE);
+        }
+        munmap (logMap, (size_t) logCtrl->mapSize);
+        logMap = NULL;
+    }
+}
+
+/**
+ *  \brief Initialization of the ring of records.
+ *
+ *  \param p_ring pointer to the ring of records
+ */
+void createLogRing (LOG_RING *p_ring)
+{
+    uint32_t t;
+
+    p_ring->head = 0;
+    p_ring->tail = 0;
+    p_ring->closed = false;
+    for (t = 0; t < LOG_RING_SIZE; t++) {
+        p_ring->slot[t].turn = t;
+    }
 }
 
+/**
+ *  \brief Writing all the records currently queued in the ring (logger process only).
+ *
+ *  In LOG_LEVEL_TRANS level, the records that show no transition are dropped here, since the producers queue
+ *  them without locking.
+ *
+ *  \return number of records drained
+ */
+unsigned int drainLog (void)
+{
+    uint32_t t;                                                                          /* next ticket to drain */
+    LOG_SLOT *slot;
+    unsigned int n = 0;
+
+    if (logRing == NULL) {
+        return 0;
+    }
+
+    t = logRing->tail;
+    slot = &logRing->slot[t % LOG_RING_SIZE];
+    while (__atomic_load_n (&slot->turn, __ATOMIC_ACQUIRE) == t + 1) {
+        if ((logCtrl->level != LOG_LEVEL_TRANS) || keepRecord (&slot->fSt)) {
+            emitState (&slot->fSt, t, slot->time, slot->writer);
+        }
+        __atomic_store_n (&slot->turn, t + LOG_RING_SIZE, __ATOMIC_RELEASE);              /* slot free again */
+        t += 1;
+        n += 1;
+        slot = &logRing->slot[t % LOG_RING_SIZE];
+    }
+    logRing->tail = t;
+
+    return n;
+}
+
+/**
+ *  \brief Signalling the logger process that no more records will be queued in the ring.
+ *
+ *  \param p_ring pointer to the ring of records
+ */
+void closeLogRing (LOG_RING *p_ring)
+{
+    __atomic_store_n (&p_ring->closed, true, __ATOMIC_RELEASE);
+}
@@ -7,7 +7,13 @@
  *
  *  Defined operations:
  *     \li file initialization
- *     \li writing the present full state as a single line at the end of the file.
+ *     \li attachment of the calling process to the log
+ *     \li writing the present full state as a single line at the end of the file
+ *     \li serialization of the updates of the state with the records of all processes
+ *     \li flushing of the records buffered by the calling process
+ *     \li termination of the log
+ *     \li initialization, draining and closing of the ring of records written by the logger process
+ *     \li access to the fields of a record by their position in the line.
  *
  *  \author Nuno Lau - December 2019
  */
@@ -15,8 +21,238 @@
 #ifndef LOGGING_H_
 #define LOGGING_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "probDataStruct.h"
 
+/* Flush policy constants */
+
+/** \brief records are written to the file as soon as they are produced */
+#define  LOG_FLUSH_RECORD     0
+/** \brief records are written to the file in batches of <tt>batch</tt> records */
+#define  LOG_FLUSH_BATCH      1
+/** \brief records are written to the file only when the buffer fills up or the process terminates */
+#define  LOG_FLUSH_EXIT       2
+
+/** \brief size of the per-process buffer where records are formatted (in bytes) */
+#define  LOG_BUFSIZE          65536
+
+/* Sink constants */
+
+/** \brief records are appended with write() on a descriptor opened for appending */
+#define  LOG_SINK_WRITE       0
+/** \brief records are copied into a shared mapping of the preallocated file */
+#define  LOG_SINK_MMAP        1
+/** \brief buffers of records are submitted as asynchronous, linked writes through io_uring */
+#define  LOG_SINK_URING       2
+
+/** \brief number of buffers of LOG_BUFSIZE bytes (and of submission queue entries) of the LOG_SINK_URING sink */
+#define  LOG_URING_DEPTH      8
+
+/** \brief default size preallocated for the LOG_SINK_MMAP sink (in bytes) */
+#define  LOG_MAPSIZE          (64ULL << 20)
+
+/* Compressor constants */
+
+/** \brief completed segments of a rotated log are kept as they are */
+#define  LOG_ZIP_NONE         0
+/** \brief completed segments of a rotated log are compressed with gzip */
+#define  LOG_ZIP_GZIP         1
+/** \brief completed segments of a rotated log are compressed with zstd */
+#define  LOG_ZIP_ZSTD         2
+
+/* Log format constants */
+
+/** \brief one padded text line per record */
+#define  LOG_FMT_TEXT         0
+/** \brief one fixed-size LOG_BIN_RECORD per record, after a LOG_BIN_HEADER */
+#define  LOG_FMT_BINARY       1
+/** \brief text lines holding only the fields changed since the previous record, as "+ field=value ..." */
+#define  LOG_FMT_DELTA        2
+
+/* Log level constants */
+
+/** \brief every record is written (full trace) */
+#define  LOG_LEVEL_FULL       0
+/** \brief records are only written when the state of some entity changed */
+#define  LOG_LEVEL_TRANS      1
+/** \brief one snapshot is written every <tt>period</tt> ms, at most */
+#define  LOG_LEVEL_PERIODIC   2
+/** \brief no record is written */
+#define  LOG_LEVEL_OFF        3
+
+/** \brief number of fields of a text record (agent, watchers, smokers, inventory and cigarettes) */
+#define  LOG_NFIELDS          (1 + 2 * NUMINGREDIENTS + 2 * NUMSMOKERS)
+
+/* Writer identification constants */
+
+/** \brief main process writer id */
+#define  LOG_MAIN             0
+/** \brief agent writer id */
+#define  LOG_AGENT            1
+/** \brief writer id of the watcher of ingredient w */
+#define  LOG_WATCHER(w)       (2 + (w))
+/** \brief writer id of smoker s */
+#define  LOG_SMOKER(s)        (2 + NUMINGREDIENTS + (s))
+/** \brief logger process writer id */
+#define  LOG_LOGGER           (2 + NUMINGREDIENTS + NUMSMOKERS)
+
+/** \brief number of slots in the ring of records (power of 2) */
+#define  LOG_RING_SIZE        1024
+
+/** \brief binary log file magic number */
+#define  LOG_BIN_MAGIC        "SMKB"
+/** \brief binary log format version */
+#define  LOG_BIN_VERSION      1
+
+/**
+ *  \brief Definition of <em>binary log file header</em> data type.
+ */
+typedef struct __attribute__ ((packed)) {
+    /** \brief LOG_BIN_MAGIC */
+    char magic[4];
+    /** \brief LOG_BIN_VERSION */
+    uint8_t version;
+    /** \brief number of ingredients */
+    uint8_t nIngredients;
+    /** \brief number of smokers */
+    uint8_t nSmokers;
+    /** \brief size of each record (in bytes) */
+    uint8_t recSize;
+    /** \brief wall clock time of the log creation (in ns since the Epoch) */
+    uint64_t start;
+} LOG_BIN_HEADER;
+
+/**
+ *  \brief Definition of <em>binary log record</em> data type.
+ */
+typedef struct __attribute__ ((packed)) {
+    /** \brief sequence number of the record, common to all writers */
+    uint32_t seq;
+    /** \brief time elapsed since the log creation (in ns) */
+    uint64_t time;
+    /** \brief id of the writer (one of the LOG_MAIN, LOG_AGENT, LOG_WATCHER or LOG_SMOKER values) */
+    uint8_t writer;
+    /** \brief agent state */
+    uint8_t agentStat;
+    /** \brief watchers state */
+    uint8_t watcherStat[NUMINGREDIENTS];
+    /** \brief smokers state */
+    uint8_t smokerStat[NUMSMOKERS];
+    /** \brief inventory of ingredients */
+    int16_t ingredients[NUMINGREDIENTS];
+    /** \brief number of cigarettes each smoker smoked */
+    uint32_t nCigarettes[NUMSMOKERS];
+} LOG_BIN_RECORD;
+
+/**
+ *  \brief Definition of <em>update sequence number</em> data type, in a cache line of its own.
+ */
+typedef struct {
+    /** \brief number of updates begun and ended by the writer: odd while one is in progress */
+    uint32_t val;
+} __attribute__ ((aligned (CACHE_LINE))) LOG_SEQ;
+
+/**
+ *  \brief Definition of <em>logging control block</em> data type.
+ *
+ *  It is stored in shared memory, so that every process writing to the log follows the same policy.
+ */
+typedef struct {
+    /** \brief flush policy (one of the LOG_FLUSH_* constants) */
+    unsigned int flush;
+    /** \brief number of records per batch, when flush is LOG_FLUSH_BATCH */
+    unsigned int batch;
+    /** \brief log format (one of the LOG_FMT_* constants) */
+    unsigned int format;
+    /** \brief sequence number of the next binary record */
+    uint32_t seq;
+    /** \brief monotonic clock reading at the log creation (in ns) */
+    uint64_t t0;
+    /** \brief records are queued in the ring and written to the file by the logger process */
+    bool ring;
+    /** \brief a record was already written in LOG_FMT_DELTA format */
+    bool lastValid;
+    /** \brief fields of the last record written in LOG_FMT_DELTA format */
+    int last[LOG_NFIELDS];
+    /** \brief log level (one of the LOG_LEVEL_* constants) */
+    unsigned int level;
+    /** \brief time between snapshots, when level is LOG_LEVEL_PERIODIC (in ms) */
+    unsigned int period;
+    /** \brief monotonic clock reading after which the next periodic snapshot is due (in ns) */
+    uint64_t nextSnap;
+    /** \brief a record was already kept in LOG_LEVEL_TRANS level */
+    bool lastStValid;
+    /** \brief state of the entities in the last record kept in LOG_LEVEL_TRANS level */
+    STAT lastSt;
+    /** \brief sink (one of the LOG_SINK_* constants) */
+    unsigned int sink;
+    /** \brief size of the file preallocated and mapped by the LOG_SINK_MMAP sink (in bytes) */
+    uint64_t mapSize;
+    /** \brief offset where the next record is copied by the LOG_SINK_MMAP sink, reserved by an atomic fetch-add */
+    uint64_t mapOff;
+    /** \brief the log is rotated once its current segment holds this many bytes (0: no size limit) */
+    uint64_t rotBytes;
+    /** \brief the log is rotated once its current segment holds this many records (0: no record limit) */
+    uint32_t rotRecords;
+    /** \brief compressor of the completed segments (one of the LOG_ZIP_* constants) */
+    unsigned int zip;
+    /** \brief descriptor of the socket the names of the completed segments are sent to the compressor through,
+     *         inherited by every process attached to the log */
+    int zipFd;
+    /** \brief spinlock serializing the writes of all processes while rotation is enabled */
+    int rotLock;
+    /** \brief number of the segment being written (starting at 1) */
+    uint32_t segment;
+    /** \brief number of bytes in the segment being written */
+    uint64_t segBytes;
+    /** \brief number of records in the segment being written */
+    uint32_t segRecords;
+    /** \brief number of records in the completed segments */
+    uint64_t segFirst;
+    /** \brief number of orders served (cigarettes smoked) in the last record written */
+    int lastOrders;
+    /** \brief wall clock time of the log creation (in ns since the Epoch), repeated in the header of each segment */
+    uint64_t start;
+    /** \brief spinlock serializing the records of all processes (see lockLog) */
+    int stLock;
+    /** \brief sequence number of the updates of the full state by each writer (see beginUpdate) */
+    LOG_SEQ stSeq[LOG_LOGGER];
+} LOG_CTRL;
+
+/**
+ *  \brief Definition of <em>ring slot</em> data type.
+ */
+typedef struct {
+    /** \brief ticket of the producer allowed to fill the slot, plus one once it is filled */
+    uint32_t turn;
+    /** \brief id of the writer */
+    unsigned int writer;
+    /** \brief time elapsed since the log creation (in ns) */
+    uint64_t time;
+    /** \brief snapshot of the full state */
+    FULL_STAT fSt;
+} LOG_SLOT;
+
+/**
+ *  \brief Definition of <em>ring of records</em> data type.
+ *
+ *  Multiple producers take tickets with an atomic increment of <tt>head</tt> and fill the slot of their ticket;
+ *  a single consumer, the logger process, drains the slots in ticket order. No lock is involved: a producer only
+ *  waits when the ring is full.
+ */
+typedef struct {
+    /** \brief next ticket to be taken by a producer */
+    uint32_t head;
+    /** \brief next ticket to be drained by the logger */
+    uint32_t tail;
+    /** \brief no more records will be produced */
+    bool closed;
+    /** \brief slots */
+    LOG_SLOT slot[LOG_RING_SIZE];
+} LOG_RING;
+
 /**
  *  \brief File initialization.
  *
@@ -27,18 +263,164 @@
  *       \li a title line
  *       \li a blank line.
  *
+ *  When the calling process is attached to the log in LOG_FMT_BINARY format, a LOG_BIN_HEADER is written instead.
+ *  In LOG_FMT_DELTA format, the first record that follows is written in full.
+ *  With the LOG_SINK_MMAP sink, the file is then preallocated to <tt>mapSize</tt> bytes.
+ *  When rotation is enabled, the index of segments (<tt>nFic</tt> followed by ".idx") is created as well, and so
+ *  is the process that compresses the completed segments, unless <tt>zip</tt> is LOG_ZIP_NONE.
+ *
  *  \param nFic name of the logging file
  */
 extern void createLog (char nFic[], FULL_STAT *p_fSt);
 
+/**
+ *  \brief Attachment of the calling process to the log.
+ *
+ *  The logging file is opened for appending once and stays open until the process terminates.
+ *  Records are formatted into a per-process buffer and written to the file according to the
+ *  flush policy stored in <tt>p_lc</tt>. Any records still buffered are written on process termination.
+ *  If <tt>nFic</tt> is a null pointer or a null string, stdout is used.
+ *
+ *  When the ring is enabled in <tt>p_lc</tt>, records are queued in <tt>p_ring</tt> instead, except for the
+ *  logger process, which drains them.
+ *  With the LOG_SINK_MMAP sink, the file is mapped instead, and records are copied straight into the mapping
+ *  regardless of the flush policy.
+ *  With the LOG_SINK_URING sink, each buffer is submitted through io_uring when the flush policy says so, and the
+ *  process moves on to another buffer without waiting for the write; if io_uring is not available, the
+ *  LOG_SINK_WRITE sink is used instead.
+ *
+ *  When <tt>rotBytes</tt> or <tt>rotRecords</tt> is set in <tt>p_lc</tt> (LOG_SINK_WRITE sink only), the write
+ *  that fills the current segment renames the file to <tt>nFic</tt> followed by "." and the segment number, starts
+ *  a new file with its own header, and records the segment in the index. The completed segment is handed to the
+ *  compressor process started by createLog, which the simulation never waits for.
+ *
+ *  \param nFic name of the logging file
+ *  \param p_lc pointer to the logging control block
+ *  \param p_ring pointer to the ring of records (may be null when the ring is not enabled)
+ *  \param writer id of the calling process
+ */
+extern void logAttach (char nFic[], LOG_CTRL *p_lc, LOG_RING *p_ring, unsigned int writer);
+
+/**
+ *  \brief Getting a field of the full state by its position in a text record.
+ *
+ *  \param p_fSt pointer to the full state
+ *  \param f field position (0 .. LOG_NFIELDS-1)
+ *
+ *  \return value of the field
+ */
+extern int getLogField (FULL_STAT *p_fSt, unsigned int f);
+
+/**
+ *  \brief Setting a field of the full state by its position in a text record.
+ *
+ *  \param p_fSt pointer to the full state
+ *  \param f field position (0 .. LOG_NFIELDS-1)
+ *  \param val new value of the field
+ */
+extern void setLogField (FULL_STAT *p_fSt, unsigned int f, int val);
+
 /**
  *  \brief write a log record (complete line) that includes the state of all entities and more info.
  *
- *  If <tt>nFic</tt> is a null pointer or a null string, the lines are written to stdout
+ *  If <tt>nFic</tt> is a null pointer or a null string, the lines are written to stdout.
+ *  If the calling process is not yet attached to the log, it is attached with the LOG_FLUSH_RECORD policy.
+ *  Records not selected by the log level are discarded.
  *
  *  \param nFic name of the logging file
  *  \param p_fSt pointer to the location where the full internal state of the problem is stored
  */
 extern void saveState (char nFic[], FULL_STAT *p_fSt);
 
+/**
+ *  \brief Locking of the log.
+ *
+ *  saveState holds a spinlock shared by all processes while it takes a snapshot of the full state and writes it,
+ *  so records appear in the order their snapshots were taken. It is only taken when a record is written: the
+ *  updates of the full state need no lock, since saveState copies the state consistently (see readState).
+ *  The lock is taken inside the critical region of the mutex, never the other way around.
+ */
+extern void lockLog (void);
+
+/**
+ *  \brief Unlocking of the log (see lockLog).
+ */
+extern void unlockLog (void);
+
+/**
+ *  \brief Start of an update of the full state by the calling process.
+ *
+ *  Every update of the full state is enclosed by beginUpdate and endUpdate, which make the sequence number of the
+ *  calling process odd while it is in progress, so that readers which take no lock (readState) can tell a torn
+ *  copy. Each process only writes its own sequence number, in a cache line of its own, so the updates of
+ *  different processes are neither serialized nor contend for a line; the numbers are kept whatever the log
+ *  level, and even in builds without logging, for the monitors.
+ */
+extern void beginUpdate (void);
+
+/**
+ *  \brief End of an update of the full state by the calling process (see beginUpdate).
+ */
+extern void endUpdate (void);
+
+/**
+ *  \brief Reading of a snapshot of the full state without locking.
+ *
+ *  The full state is copied optimistically, and the copy is taken again whenever the sequence number of some
+ *  writer shows that an update was in progress or happened meanwhile (see beginUpdate).
+ *
+ *  \param p_lc pointer to the logging control block holding the sequence numbers
+ *  \param p_fSt pointer to the full state
+ *  \param snap where the snapshot is stored
+ *
+ *  \return number of copies discarded because they were torn
+ */
+extern unsigned int readState (LOG_CTRL *p_lc, FULL_STAT *p_fSt, FULL_STAT *snap);
+
+/* builds with LOG_DISABLED defined (make LOG=off) compile every call to saveState and to the log lock out */
+#ifdef LOG_DISABLED
+#define  saveState(nFic, p_fSt)     ((void) 0)
+#define  lockLog()                  ((void) 0)
+#define  unlockLog()                ((void) 0)
+#endif
+
+/**
+ *  \brief Writing to the file all the records buffered by the calling process.
+ *
+ *  With the LOG_SINK_URING sink, it only returns once every write submitted by the calling process completed.
+ */
+extern void flushLog (void);
+
+/**
+ *  \brief Termination of the log.
+ *
+ *  Records buffered by the calling process are written. With the LOG_SINK_MMAP sink, the file is truncated to the
+ *  length actually used, so it must only be called once every other process stopped writing.
+ *  When rotation is enabled, the last segment (the file itself, never compressed) is recorded in the index.
+ */
+extern void endLog (void);
+
+/**
+ *  \brief Initialization of the ring of records.
+ *
+ *  \param p_ring pointer to the ring of records
+ */
+extern void createLogRing (LOG_RING *p_ring);
+
+/**
+ *  \brief Writing all the records currently queued in the ring (logger process only).
+ *
+ *  In LOG_LEVEL_TRANS level, the records that show no transition are dropped here.
+ *
+ *  \return number of records drained
+ */
+extern unsigned int drainLog (void);
+
+/**
+ *  \brief Signalling the logger process that no more records will be queued in the ring.
+ *
+ *  \param p_ring pointer to the ring of records
+ */
+extern void closeLogRing (LOG_RING *p_ring);
+
 #endif /* LOGGING_H_ */
@@ -14,19 +14,53 @@
 #define PROBDATASTRUCT_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "probConst.h"
 
+/** \brief size of a cache line (in bytes) */
+#define  CACHE_LINE           64
+
+/*
+ *  Layout of the full state.
+ *
+ *  The fields of the full state are written by different processes. In the compact layout (default) they are
+ *  packed into a couple of cache lines, so every write by one process takes the lines away from the others.
+ *  In the padded layout (make LAYOUT=padded), the state of each entity and each element of the inventory, the
+ *  reservations and the cigarettes smoked has a cache line of its own, and the read-mostly fields share another
+ *  one. The value held in a field is always reached through SLOT. The reference agent, watcher and smoker binaries
+ *  only work with the compact layout.
+ */
+#ifdef LAYOUT_PADDED
+
+/** \brief unsigned field on a cache line of its own */
+typedef struct { unsigned int val; } __attribute__ ((aligned (CACHE_LINE))) LINE_UINT;
+/** \brief signed field on a cache line of its own */
+typedef struct { int val; } __attribute__ ((aligned (CACHE_LINE))) LINE_INT;
+/** \brief value held in a field of the full state */
+#define  SLOT(field)          ((field).val)
+
+#else
+
+/** \brief unsigned field */
+typedef unsigned int LINE_UINT;
+/** \brief signed field */
+typedef int LINE_INT;
+/** \brief value held in a field of the full state */
+#define  SLOT(field)          (field)
+
+#endif
+
 /**
  *  \brief Definition of <em>state of the intervening entities</em> data type.
  */
 typedef struct {
     /** \brief agent state */
-    unsigned int agentStat;
+    LINE_UINT agentStat;
     /** \brief watchers state */
-    unsigned int watcherStat[NUMINGREDIENTS];
+    LINE_UINT watcherStat[NUMINGREDIENTS];
     /** \brief smokers state */
-    unsigned int smokerStat[NUMSMOKERS];
+    LINE_UINT smokerStat[NUMSMOKERS];
 
 } STAT;
 
@@ -51,15 +85,23 @@ typedef struct
     bool closing;
 
     /** \brief inventory of ingredients */
-    int ingredients[NUMINGREDIENTS];
+    LINE_INT ingredients[NUMINGREDIENTS];
 
     /** \brief number of ingredients already reserved by watcher */
-    int reserved[NUMINGREDIENTS];
+    LINE_INT reserved[NUMINGREDIENTS];
 
     /** \brief number of cigarettes each smoker smoked */
-    int nCigarettes[NUMSMOKERS];
+    LINE_INT nCigarettes[NUMSMOKERS];
 
 } FULL_STAT;
 
+#ifdef LAYOUT_PADDED
+_Static_assert ((offsetof (FULL_STAT, st.watcherStat[1]) - offsetof (FULL_STAT, st.watcherStat[0]) == CACHE_LINE) &&
+                (offsetof (FULL_STAT, nIngredients) % CACHE_LINE == 0) &&
+                (offsetof (FULL_STAT, ingredients) - offsetof (FULL_STAT, closing) < CACHE_LINE) &&
+                (offsetof (FULL_STAT, ingredients) % CACHE_LINE == 0) && (sizeof (FULL_STAT) % CACHE_LINE == 0),
+                "each writer of the full state does not have a cache line of its own");
+#endif
+
 
 #endif /* PROBDATASTRUCT_H_ */
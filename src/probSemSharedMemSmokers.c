@@ -11,6 +11,56 @@
  *  Upon execution, one parameter is requested:
  *    \li name of the logging file.
  *
+ *  The following options are also accepted:
+ *    \li <tt>-f record|exit|N</tt> log flush policy: every record (default), on termination or every N records
+ *    \li <tt>-F text|binary|delta</tt> log format: padded text lines (default), fixed-size binary records or
+ *        text lines with the changed fields only, both to be converted back by <tt>logdecode</tt>
+ *    \li <tt>-l full|trans|off|N</tt> log level: every record (default), only records where the state of some
+ *        entity changed, no record at all or one snapshot every N ms
+ *    \li <tt>-w write|mmap[:MB]|uring</tt> log sink: write() calls (default), copies into a shared mapping of the
+ *        file, preallocated to MB megabytes (64 by default) and truncated to the used length at the end, or
+ *        asynchronous writes submitted through io_uring (write() calls if io_uring is not available), which
+ *        requires <tt>-r</tt> or <tt>-f exit|N</tt>
+ *    \li <tt>-r</tt> records are queued in a shared ring and written by a separate logger process
+ *        (the reference agent, watcher and smoker binaries do not support it)
+ *    \li <tt>-R N|Nk|NM</tt> log rotation: a new segment is started every N records, or once the current one holds
+ *        N kiB or MiB; completed segments are listed, with their first record and orders served, in
+ *        <tt>logfile.idx</tt> (write sink only)
+ *    \li <tt>-z gzip|zstd|none</tt> compressor of the completed segments of a rotated log (gzip by default),
+ *        run in the background
+ *    \li <tt>-s sysv|posix|pthread|futex</tt> semaphore backend (the one chosen at build time by default; the
+ *        reference agent, watcher and smoker binaries only support sysv)
+ *    \li <tt>-a N</tt> adaptive locking of the critical region: a contended down of the mutex tries again, pausing
+ *        in between, up to N times (a budget tuned by each process from the tries its past downs took) before
+ *        blocking
+ *    \li <tt>-i</tt> instrumentation of the semaphore operations: acquires, contended downs and wait and hold time
+ *        histograms of each process on each semaphore, summarized on the standard error at the end
+ *    \li <tt>-T ms</tt> time limit of the downs of the agent, watchers and smokers; when one of them fails, or the
+ *        state does not change for twice the limit (entities that do not enforce it, like the reference binaries),
+ *        the full state and the values of the semaphores are printed on the standard error, the remaining entities
+ *        are killed and the run ends in failure
+ *    \li <tt>-g</tt> fine-grained locking: a lock per ingredient and a lock for the matching of reservations
+ *        instead of the mutex (the reference agent, watcher and smoker binaries do not support it)
+ *    \li <tt>-q</tt> the agent delivers the ingredients through a ring per watcher, which the watcher drains without
+ *        locking and only blocks on when it is empty (the reference agent and watcher binaries do not support it)
+ *    \li <tt>-m sysv|memfd|posix[,huge][,populate][,lock]</tt> shared memory backend (the one chosen at build time
+ *        by default): a SysV block found through the key, or a memfd or POSIX shared memory file whose descriptor the
+ *        entities inherit, optionally on huge pages, allocated up front and locked in memory (the reference agent,
+ *        watcher and smoker binaries only support sysv)
+ *    \li <tt>-k key|auto</tt> key of the semaphore set and the shared region: the one given, or a unique one
+ *        generated for the run, instead of the one of the current directory, so that several simulations may run
+ *        at once from the same directory; the error files are then named after the key as well. A key given takes
+ *        up to 24 bits, and gets the project id 'a' (0x61) in its first byte, as the keys of ftok and the ones
+ *        generated; a key that already has it is also accepted (parseKey)
+ *    \li <tt>-e seed</tt> seed of the random generators of the agent, watchers and smokers (each process seeds its
+ *        own from its pid by default), so that the ingredients prepared and the rolling and smoking times of a run
+ *        can be repeated (the reference agent, watcher and smoker binaries ignore it).
+ *
+ *  The entities are killed when the generator process terminates, and the semaphore set and the shared region are
+ *  released when it exits or is stopped by SIGINT, SIGTERM, SIGHUP, SIGQUIT or SIGPIPE (the reader of the log on
+ *  the standard output went away); a run killed otherwise, with SIGKILL or by a crash, leaves them behind (see
+ *  clean.sh).
+ *
  *  \author Nuno Lau - December 2019
  */
 
@@ -18,11 +68,15 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
+#include <sys/prctl.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <errno.h>
 
 #include "probConst.h"
 #include "probDataStruct.h"
@@ -30,6 +84,7 @@
 #include "sharedDataSync.h"
 #include "semaphore.h"
 #include "sharedMemory.h"
+#include "sharedLocks.h"
 
 /** \brief name of agent program */
 #define   AGENT               "./agent"
@@ -40,6 +95,419 @@
 /** \brief name of smoker program */
 #define   SMOKER              "./smoker"
 
+/** \brief name of logger program */
+#define   LOGGER              "./logger"
+
+/** \brief interval between checks of the state while waiting for the intervening entities (in ms) */
+#define   POLL                10
+
+/** \brief number of keys tried before giving up on a unique one */
+#define   KEYTRIES            64
+
+/** \brief shared memory access identifier (-1 when there is no shared region) */
+static int shmid = -1;
+
+/** \brief semaphore set access identifier (-1 when there is no semaphore set) */
+static int semgid = -1;
+
+/** \brief intervening entities process identifiers (0 when the process was not generated) */
+static int pidAG, pidLG, pidWT[NUMINGREDIENTS], pidSM[NUMSMOKERS];
+
+/** \brief generator process identifier (children run the exit handlers until they call exec) */
+static pid_t pidMain;
+
+/** \brief signal that stopped the generator process (0 while it was not stopped) */
+static volatile sig_atomic_t stopped = 0;
+
+/**
+ *  \brief Printing the command line syntax and terminating.
+ *
+ *  \param prog name of the program
+ */
+static void usage (char *prog)
+{
+    fprintf (stderr, "USAGE: %s [-f record|exit|N] [-F text|binary|delta] [-l full|trans|off|N] [-w write|mmap[:MB]|uring] [-r] [-R N|Nk|NM] [-z gzip|zstd|none] [-s sysv|posix|pthread|futex] [-a N] [-i] [-T ms] [-g] [-q] [-m sysv|memfd|posix[,huge][,populate][,lock]] [-k key|auto] [-e seed] [logfile]\n", prog);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ *  \brief Parsing of the log flush policy.
+ *
+ *  \param spec policy given on the command line
+ *  \param p_lc pointer to the logging control block to be filled in
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the policy is not valid
+ */
+static int parseFlush (char *spec, LOG_CTRL *p_lc)
+{
+    char *tinp;                                                                  /* numerical parameters test flag */
+    long n;                                                                                  /* records per batch */
+
+    if (strcmp (spec, "record") == 0) {
+        p_lc->flush = LOG_FLUSH_RECORD;
+        p_lc->batch = 1;
+        return 0;
+    }
+    if (strcmp (spec, "exit") == 0) {
+        p_lc->flush = LOG_FLUSH_EXIT;
+        p_lc->batch = 1;
+        return 0;
+    }
+    n = strtol (spec, &tinp, 0);
+    if ((*tinp != '\0') || (n <= 0)) {
+        return -1;
+    }
+    p_lc->flush = LOG_FLUSH_BATCH;
+    p_lc->batch = (unsigned int) n;
+    return 0;
+}
+
+/**
+ *  \brief Parsing of the log level.
+ *
+ *  \param spec level given on the command line
+ *  \param p_lc pointer to the logging control block to be filled in
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the level is not valid
+ */
+static int parseLevel (char *spec, LOG_CTRL *p_lc)
+{
+    char *tinp;                                                                  /* numerical parameters test flag */
+    long n;                                                                              /* period between snapshots */
+
+    if (strcmp (spec, "full") == 0) {
+        p_lc->level = LOG_LEVEL_FULL;
+        return 0;
+    }
+    if (strcmp (spec, "trans") == 0) {
+        p_lc->level = LOG_LEVEL_TRANS;
+        return 0;
+    }
+    if (strcmp (spec, "off") == 0) {
+        p_lc->level = LOG_LEVEL_OFF;
+        return 0;
+    }
+    n = strtol (spec, &tinp, 0);
+    if ((*tinp != '\0') || (n <= 0)) {
+        return -1;
+    }
+    p_lc->level = LOG_LEVEL_PERIODIC;
+    p_lc->period = (unsigned int) n;
+    return 0;
+}
+
+/**
+ *  \brief Parsing of the log sink.
+ *
+ *  \param spec sink given on the command line
+ *  \param p_lc pointer to the logging control block to be filled in
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the sink is not valid
+ */
+static int parseSink (char *spec, LOG_CTRL *p_lc)
+{
+    char *tinp;                                                                  /* numerical parameters test flag */
+    long n;                                                                               /* preallocated size */
+
+    if (strcmp (spec, "write") == 0) {
+        p_lc->sink = LOG_SINK_WRITE;
+        return 0;
+    }
+    if (strcmp (spec, "uring") == 0) {
+        p_lc->sink = LOG_SINK_URING;
+        return 0;
+    }
+    if (strncmp (spec, "mmap", 4) != 0) {
+        return -1;
+    }
+    p_lc->sink = LOG_SINK_MMAP;
+    p_lc->mapSize = LOG_MAPSIZE;
+    if (spec[4] == '\0') {
+        return 0;
+    }
+    if (spec[4] != ':') {
+        return -1;
+    }
+    n = strtol (spec + 5, &tinp, 0);
+    if ((*tinp != '\0') || (n <= 0)) {
+        return -1;
+    }
+    p_lc->mapSize = (uint64_t) n << 20;
+    return 0;
+}
+
+/**
+ *  \brief Parsing of the log rotation threshold.
+ *
+ *  \param spec threshold given on the command line: a number of records, or a size followed by k or M
+ *  \param p_lc pointer to the logging control block to be filled in
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the threshold is not valid
+ */
+static int parseRotate (char *spec, LOG_CTRL *p_lc)
+{
+    char *tinp;                                                                  /* numerical parameters test flag */
+    long n;                                                                                          /* threshold */
+
+    n = strtol (spec, &tinp, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    if (strcmp (tinp, "k") == 0) {
+        p_lc->rotBytes = (uint64_t) n << 10;
+    }
+    else if (strcmp (tinp, "M") == 0) {
+        p_lc->rotBytes = (uint64_t) n << 20;
+    }
+    else if (*tinp == '\0') {
+        p_lc->rotRecords = (uint32_t) n;
+    }
+    else return -1;
+    return 0;
+}
+
+/**
+ *  \brief Name of a semaphore of the set.
+ *
+ *  \param i semaphore location in the set
+ *  \param buf where the name is printed
+ *
+ *  \return buf
+ */
+static char *semName (unsigned int i, char *buf)
+{
+    if (i == MUTEX) {
+        strcpy (buf, "mutex");
+    }
+    else if (i == WAITCIGARETTE) {
+        strcpy (buf, "waitCigarette");
+    }
+    else if (i < WAIT2INGS) {
+        sprintf (buf, "ingredient[%u]", i - INGREDIENT);
+    }
+    else if (i < INGLOCK) {
+        sprintf (buf, "wait2Ings[%u]", i - WAIT2INGS);
+    }
+    else if (i < RESERVELOCK) {
+        sprintf (buf, "ingLock[%u]", i - INGLOCK);
+    }
+    else strcpy (buf, "reserveLock");
+    return buf;
+}
+
+/**
+ *  \brief Percentile of a time histogram.
+ *
+ *  \param hist histogram (bin k counts durations of 2^k up to 2^(k+1) ns)
+ *  \param q fraction of the durations (0 .. 1)
+ *
+ *  \param buf where the upper bound (in ns) of the bin holding the percentile is printed ("-" if the histogram is
+ *         empty)
+ *
+ *  \return buf
+ */
+static char *percentile (const uint64_t hist[], double q, char *buf)
+{
+    uint64_t total = 0, sum = 0;
+    unsigned int k;
+
+    for (k = 0; k < SEM_HISTBINS; k++) {
+        total += hist[k];
+    }
+    for (k = 0; k < SEM_HISTBINS - 1; k++) {
+        sum += hist[k];
+        if (sum >= q * total) {
+            break;
+        }
+    }
+    if (total == 0) {
+        strcpy (buf, "-");
+    }
+    else sprintf (buf, "%llu", 2ULL << k);
+    return buf;
+}
+
+/**
+ *  \brief Printing the statistics of the operations of the intervening entities on the semaphores.
+ *
+ *  Times are the upper bounds of the histogram bins holding the median and the 99th percentile; hold times are
+ *  only measured when the process that carried out the down also carries out the up.
+ *
+ *  \param sh pointer to the shared region
+ */
+static void printSemStats (SHARED_DATA *sh)
+{
+    char proc[8], sem[20], pct[4][24];
+    unsigned int p, i;
+
+    fprintf (stderr, "%-7s %-16s %10s %10s %10s %10s %10s %10s\n", "Process", "Semaphore", "Acquires", "Contended",
+             "Wait p50", "Wait p99", "Hold p50", "Hold p99");
+    for (p = LOG_AGENT; p < LOG_LOGGER; p++) {
+        if (p == LOG_AGENT) {
+            strcpy (proc, "AG");
+        }
+        else if (p < LOG_SMOKER (0)) {
+            sprintf (proc, "WT%u", p - LOG_WATCHER (0));
+        }
+        else sprintf (proc, "SM%u", p - LOG_SMOKER (0));
+        for (i = 1; i <= SEM_NU; i++) {
+            SEM_USAGE *st = &sh->semStats[p][i-1];
+
+            if (st->acquires == 0) {
+                continue;
+            }
+            fprintf (stderr, "%-7s %-16s %10llu %10llu %10s %10s %10s %10s\n", proc, semName (i, sem),
+                     (unsigned long long) st->acquires, (unsigned long long) st->contended,
+                     percentile (st->wait, 0.5, pct[0]), percentile (st->wait, 0.99, pct[1]),
+                     percentile (st->hold, 0.5, pct[2]), percentile (st->hold, 0.99, pct[3]));
+        }
+    }
+}
+
+/**
+ *  \brief Printing the full state of the problem and the values of the semaphores, when a run is stopped.
+ *
+ *  The state is read without entering the critical region, since the process holding it may never leave.
+ *
+ *  \param sh pointer to the shared region
+ *  \param semgid semaphore set access identifier
+ */
+static void printDiagnostics (SHARED_DATA *sh, int semgid)
+{
+    char sem[20];
+    unsigned int i;
+
+    fprintf (stderr, "Agent: state %u, orders %d, closing %s\n", SLOT (sh->fSt.st.agentStat), sh->fSt.nOrders,
+             sh->fSt.closing ? "yes" : "no");
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        fprintf (stderr, "Watcher %u: state %u, ingredients %d, reserved %d\n", i, SLOT (sh->fSt.st.watcherStat[i]),
+                 SLOT (sh->fSt.ingredients[i]), SLOT (sh->fSt.reserved[i]));
+    }
+    for (i = 0; i < NUMSMOKERS; i++) {
+        fprintf (stderr, "Smoker %u: state %u, cigarettes %d\n", i, SLOT (sh->fSt.st.smokerStat[i]),
+                 SLOT (sh->fSt.nCigarettes[i]));
+    }
+    for (i = 0; sh->rings && (i < NUMINGREDIENTS); i++) {
+        fprintf (stderr, "Delivery ring %u: delivered %u, collected %u, watcher %s\n", i, sh->delivery[i].head,
+                 sh->delivery[i].tail, sh->delivery[i].sleeping ? "blocking" : "running");
+    }
+    for (i = 1; i <= SEM_NU; i++) {
+        fprintf (stderr, "Semaphore %s: %d\n", semName (i, sem), semValue (semgid, i));
+    }
+}
+
+/**
+ *  \brief Killing an intervening entity process, unless it has already terminated.
+ *
+ *  \param pid process identifier (-1 when the process was not generated)
+ */
+static void stopEntity (int pid)
+{
+    int status;
+
+    if ((pid > 0) && (waitpid (pid, &status, WNOHANG) == 0)) {
+        kill (pid, SIGKILL);
+        waitpid (pid, &status, 0);
+    }
+}
+
+/**
+ *  \brief Releasing the processes and the resources of the run.
+ *
+ *  The intervening entities still running are killed, and the semaphore set and the shared region are destroyed.
+ *  It runs on exit and when the generator process is stopped by a signal (see stopRun).
+ */
+static void release (void)
+{
+    unsigned int i;
+
+    if (getpid () != pidMain) {
+        return;
+    }
+    stopEntity (pidAG);
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        stopEntity (pidWT[i]);
+    }
+    for (i = 0; i < NUMSMOKERS; i++) {
+        stopEntity (pidSM[i]);
+    }
+    stopEntity (pidLG);
+    if (semgid != -1) {
+        semDestroy (semgid);
+        semgid = -1;
+    }
+    if (shmid != -1) {
+        shmemDestroy (shmid);
+        shmid = -1;
+    }
+}
+
+/**
+ *  \brief Binding an intervening entity process, before exec, to the generator process, so that it is killed when
+ *         the generator process terminates, and to the shared region, which it inherits.
+ */
+static void bindEntity (void)
+{
+    prctl (PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid () != pidMain) {                                      /* the generator process terminated meanwhile */
+        _exit (EXIT_FAILURE);
+    }
+    if (shmemInherit (shmid) == -1) {
+        perror ("error on passing the shared region to an intervening entity");
+        _exit (EXIT_FAILURE);
+    }
+}
+
+/**
+ *  \brief Handler of the signals that stop the generator process.
+ *
+ *  Only async-signal-safe calls are made: the signal is recorded, for the main loop to release the run, and the
+ *  intervening entities already generated are killed, so that a wait for them returns at once.
+ *
+ *  \param sig signal
+ */
+static void interrupted (int sig)
+{
+    unsigned int i;
+
+    stopped = sig;
+    if (getpid () != pidMain) {
+        return;
+    }
+    if (pidAG > 0) {
+        kill (pidAG, SIGKILL);
+    }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        if (pidWT[i] > 0) {
+            kill (pidWT[i], SIGKILL);
+        }
+    }
+    for (i = 0; i < NUMSMOKERS; i++) {
+        if (pidSM[i] > 0) {
+            kill (pidSM[i], SIGKILL);
+        }
+    }
+    if (pidLG > 0) {
+        kill (pidLG, SIGKILL);
+    }
+}
+
+/**
+ *  \brief Ending the run if the generator process was stopped by a signal: the run is released and the signal is
+ *         raised again, with its default action.
+ */
+static void stopRun (void)
+{
+    if (stopped != 0) {
+        release ();
+        signal (stopped, SIG_DFL);
+        raise (stopped);
+    }
+}
 
 /**
  *  \brief Main program.
@@ -50,56 +518,253 @@
 int main (int argc, char *argv[])
 {
     char nFic[51];                                                                              /*name of logging file */
-    char nFicErr[] = "error_        ";                                                     /* base name of error files */
-    int shmid,                                                                      /* shared memory access identifier */
-        semgid;                                                                     /* semaphore set access identifier */
+    char nFicErr[32] = "error_";                                                           /* base name of error files */
     unsigned int  m;                                                                             /* counting variables */
     SHARED_DATA *sh;                                                                /* pointer to shared memory region */
-    int pidAG,                                                                             /* agent process identifier */
-        pidWT[NUMINGREDIENTS],                                                    /* watchers process identifier array */
-        pidSM[NUMSMOKERS];                                                         /* smokers process identifier array */
-    int key;                                                           /*access key to shared memory and semaphore set */
-    char num[2][12];                                                     /* numeric value conversion (up to 10 digits) */
+    int key = IPC_PRIVATE;                                             /*access key to shared memory and semaphore set */
+    bool keyGiven = false,                                                         /* the key was given (-k key|auto) */
+         keyAuto = false;                                                         /* a unique key is generated (-k auto) */
+    unsigned int tries;                                                                        /* number of keys tried */
+    char errTag[12] = "";                                                          /* suffix of the error files names */
+    struct sigaction sa;                                                      /* handling of the signals that stop us */
+    int stops[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGPIPE };                           /* signals that stop us */
+    char num[2][12+SHMEM_EXPORTLEN];               /* numeric value conversion (up to 10 digits, and the shared block) */
     int status,                                                                                    /* execution status */
         info;                                                                                               /* info id */
+    LOG_CTRL logCtrl = { .flush = LOG_FLUSH_RECORD, .batch = 1, .zip = LOG_ZIP_GZIP };        /* logging control block */
+    int opt;                                                                                    /* command line option */
+    unsigned int spin = 0;                                             /* tries of a down of the mutex before blocking */
+    bool instrument = false;                                                  /* semaphore operations are instrumented */
+    unsigned int timeout = 0;                                                          /* time limit of the downs (ms) */
+    bool fineLocks = false;                                                                    /* fine-grained locking */
+    bool rings = false;                                                        /* ingredients delivered through rings */
+    unsigned int seed = 0;                                                /* seed of the random generators of the run */
+    bool failed = false;                                                             /* the run was stopped in failure */
+    FULL_STAT last;                                                                       /* state at the latest check */
+    unsigned int still = 0;                                                  /* time since the state last changed (ms) */
+    char *tinp;                                                                      /* numerical parameters test flag */
 
-    /* getting log file name */
-    if(argc==2) {
-        strcpy(nFic, argv[1]);
+    /* getting options and log file name */
+    while ((opt = getopt (argc, argv, "f:F:l:w:rR:z:s:a:iT:gqm:k:e:")) != -1) {
+        switch (opt) {
+            case 'f':
+                if (parseFlush (optarg, &logCtrl) == -1) {
+                    fprintf (stderr, "Invalid log flush policy (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'F':
+                if (strcmp (optarg, "text") == 0) {
+                    logCtrl.format = LOG_FMT_TEXT;
+                }
+                else if (strcmp (optarg, "binary") == 0) {
+                    logCtrl.format = LOG_FMT_BINARY;
+                }
+                else if (strcmp (optarg, "delta") == 0) {
+                    logCtrl.format = LOG_FMT_DELTA;
+                }
+                else {
+                    fprintf (stderr, "Invalid log format (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'l':
+                if (parseLevel (optarg, &logCtrl) == -1) {
+                    fprintf (stderr, "Invalid log level (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'w':
+                if (parseSink (optarg, &logCtrl) == -1) {
+                    fprintf (stderr, "Invalid log sink (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'r':
+                logCtrl.ring = true;
+                break;
+            case 'R':
+                if (parseRotate (optarg, &logCtrl) == -1) {
+                    fprintf (stderr, "Invalid log rotation threshold (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'z':
+                if (strcmp (optarg, "gzip") == 0) {
+                    logCtrl.zip = LOG_ZIP_GZIP;
+                }
+                else if (strcmp (optarg, "zstd") == 0) {
+                    logCtrl.zip = LOG_ZIP_ZSTD;
+                }
+                else if (strcmp (optarg, "none") == 0) {
+                    logCtrl.zip = LOG_ZIP_NONE;
+                }
+                else {
+                    fprintf (stderr, "Invalid log compressor (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 's':
+                if (semSelect (optarg) == -1) {
+                    fprintf (stderr, "Invalid semaphore backend (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'a':
+                spin = (unsigned int) strtoul (optarg, &tinp, 0);
+                if ((*tinp != '\0') || (spin == 0)) {
+                    fprintf (stderr, "Invalid number of tries (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'i':
+                instrument = true;
+                break;
+            case 'g':
+                fineLocks = true;
+                break;
+            case 'q':
+                rings = true;
+                break;
+            case 'm':
+                if (shmemSelect (optarg) == -1) {
+                    fprintf (stderr, "Invalid shared memory backend (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'k':
+                keyGiven = true;
+                keyAuto = (strcmp (optarg, "auto") == 0);
+                if (!keyAuto && ((key = parseKey (optarg)) == -1)) {
+                    fprintf (stderr, "Invalid key (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'e':
+                seed = (unsigned int) strtoul (optarg, &tinp, 0);
+                if ((*tinp != '\0') || (seed == 0)) {
+                    fprintf (stderr, "Invalid seed (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            case 'T':
+                timeout = (unsigned int) strtoul (optarg, &tinp, 0);
+                if ((*tinp != '\0') || (timeout == 0)) {
+                    fprintf (stderr, "Invalid time limit (\"%s\")!\n", optarg);
+                    usage (argv[0]);
+                }
+                break;
+            default:
+                usage (argv[0]);
+        }
+    }
+    if (argc - optind > 1) {
+        usage (argv[0]);
+    }
+    if ((logCtrl.format == LOG_FMT_DELTA) && (logCtrl.flush != LOG_FLUSH_RECORD) && !logCtrl.ring) {
+        fprintf (stderr, "Delta format requires records to be flushed one at a time or the logger process!\n");
+        usage (argv[0]);
+    }
+    /* asynchronous writes of different processes complete in any order: records flushed one at a time would
+       not keep the order they were produced in, unless the logger process is the only one writing */
+    if ((logCtrl.sink == LOG_SINK_URING) && !logCtrl.ring &&
+        ((logCtrl.format == LOG_FMT_DELTA) || (logCtrl.flush == LOG_FLUSH_RECORD))) {
+        fprintf (stderr, "The io_uring log sink requires the logger process or records flushed in batches!\n");
+        usage (argv[0]);
+    }
+    if (optind < argc) {
+        strcpy(nFic, argv[optind]);
     }
     else strcpy(nFic, "");
+    if ((logCtrl.sink == LOG_SINK_MMAP) && (strlen (nFic) == 0)) {
+        fprintf (stderr, "The mmap log sink requires a log file!\n");
+        usage (argv[0]);
+    }
+    if ((logCtrl.rotBytes > 0) || (logCtrl.rotRecords > 0)) {
+        if (strlen (nFic) == 0) {
+            fprintf (stderr, "Log rotation requires a log file!\n");
+            usage (argv[0]);
+        }
+        if (logCtrl.sink != LOG_SINK_WRITE) {
+            fprintf (stderr, "Log rotation requires the write log sink!\n");
+            usage (argv[0]);
+        }
+    }
+
+    /* the run is released however the generator process terminates */
+    pidMain = getpid ();
+    pidLG = -1;
+    atexit (release);
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = interrupted;                                        /* no SA_RESTART: a wait is interrupted */
+    for (m = 0; m < sizeof (stops) / sizeof (stops[0]); m++) {
+        sigaction (stops[m], &sa, NULL);
+    }
 
     /* composing command line */
-    if ((key = ftok (".", 'a')) == -1) {
+    if (!keyGiven && ((key = ftok (".", 'a')) == -1)) {
         perror ("error on generating the key");
         exit (EXIT_FAILURE);
     }
-    sprintf (num[1], "%d", key);
 
-    /* creating and initializing the shared memory region and the log file */
-    if ((shmid = shmemCreate (key, sizeof (SHARED_DATA))) == -1) { 
-        perror ("error on creating the shared memory region");
-        exit (EXIT_FAILURE);
+    /* creating the shared memory region and the semaphore set; a generated key is replaced while it is taken */
+    for (tries = 1; ; tries++) {
+        if (keyAuto) {                                    /* project id 'a' in the first byte, as the keys of ftok */
+            struct timespec t;
+
+            clock_gettime (CLOCK_MONOTONIC, &t);
+            key = KEY_PROJECT | (((unsigned int) pidMain * 2654435761u ^ (unsigned int) t.tv_nsec) & 0xffffff);
+        }
+        if ((shmid = shmemCreate (key, sizeof (SHARED_DATA))) == -1) {
+            if (keyAuto && (errno == EEXIST) && (tries < KEYTRIES)) {
+                continue;
+            }
+            perror ("error on creating the shared memory region");
+            exit (EXIT_FAILURE);
+        }
+        if ((semgid = semCreate (key, SEM_NU)) == -1) {
+            int err = errno;
+
+            shmemDestroy (shmid);
+            shmid = -1;
+            if (keyAuto && (err == EEXIST) && (tries < KEYTRIES)) {
+                continue;
+            }
+            errno = err;
+            perror ("error on creating the semaphore set");
+            exit (EXIT_FAILURE);
+        }
+        break;
     }
+    sprintf (num[1], "%d", key);
+    if (keyGiven) {
+        sprintf (errTag, ".%08x", (unsigned int) key);
+    }
+    if (keyAuto) {
+        fprintf (stderr, "Key of the run: 0x%08x\n", (unsigned int) key);
+    }
+
+    /* initializing the shared memory region and the log file */
     if (shmemAttach (shmid, (void **) &sh) == -1) { 
         perror ("error on mapping the shared region on the process address space");
         exit (EXIT_FAILURE);
     }
+    shmemExport (shmid, num[1] + strlen (num[1]));                      /* a shared memory file follows the key */
 
     /* initialize random generator */
     srandom ((unsigned int) getpid ());                                
 
     /* initialize problem internal status */
-    sh->fSt.st.agentStat        = PREPARING;                            /* the agent prepares ingredients */
+    SLOT (sh->fSt.st.agentStat) = PREPARING;                            /* the agent prepares ingredients */
     int w;
     for (w = 0; w < NUMINGREDIENTS; w++) {
-        sh->fSt.st.watcherStat[w] = WAITING_ING;                              /* watchers are initialized */
-        sh->fSt.ingredients[w]=0;
+        SLOT (sh->fSt.st.watcherStat[w]) = WAITING_ING;                       /* watchers are initialized */
+        SLOT (sh->fSt.ingredients[w])=0;
     }
     int s;
     for (s = 0; s < NUMSMOKERS; s++) {
-        sh->fSt.st.smokerStat[s] = WAITING_2ING;                               /* smokers are initialized */
-        sh->fSt.nCigarettes[s]=0;
+        SLOT (sh->fSt.st.smokerStat[s]) = WAITING_2ING;                        /* smokers are initialized */
+        SLOT (sh->fSt.nCigarettes[s])=0;
     }
 
     sh->fSt.nIngredients = NUMINGREDIENTS;
@@ -107,10 +772,22 @@ int main (int argc, char *argv[])
 
     sh->fSt.nOrders      = NUMORDERS;
 
+    sh->spin             = spin;
+    sh->instrument       = instrument;
+    sh->timeout          = timeout;
+    sh->fineLocks        = fineLocks;
+    sh->rings            = rings;
+    sh->seed             = seed;
+    memset (sh->semStats, 0, sizeof (sh->semStats));
+
 
     /* create log file */
+    sh->logCtrl = logCtrl;
+    createLogRing (&sh->logRing);
+    logAttach (nFic, &sh->logCtrl, &sh->logRing, LOG_MAIN);
     createLog (nFic, &sh->fSt);                                  
     saveState(nFic,&sh->fSt);
+    flushLog ();                                        /* initial state must precede the records of the children */
 
     /* initialize semaphore ids */
     sh->mutex                       = MUTEX;                                /* mutual exclusion semaphore id */
@@ -119,64 +796,93 @@ int main (int argc, char *argv[])
     int i;
     for(i=0;i<NUMINGREDIENTS;i++) {
        sh->ingredient[i]            = INGREDIENT+i;                                                      
+       createDeliveryRing (&sh->delivery[i], sh->ingredient[i]);                     /* ring of each watcher */
     }
     for(s=0;s<NUMSMOKERS;s++) {
        sh->wait2Ings[s]             = WAIT2INGS+s;                                                      
     }
-
-    /* creating and initializing the semaphore set */
-    if ((semgid = semCreate (key, SEM_NU)) == -1) { 
-        perror ("error on creating the semaphore set");
-        exit (EXIT_FAILURE);
+    for(i=0;i<NUMINGREDIENTS;i++) {
+       sh->ingLock[i]               = INGLOCK+i;                                   /* lock of each ingredient */
     }
+    sh->reserveLock                 = RESERVELOCK;                                 /* lock of the reservations */
+
+    /* initializing the semaphore set */
     if (semUp (semgid, sh->mutex) == -1) {                   /* enabling access to critical region */
         perror ("error on executing the up operation for semaphore access");
         exit (EXIT_FAILURE);
     }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        if (semUp (semgid, sh->ingLock[i]) == -1) {
+            perror ("error on executing the up operation for semaphore ingLock");
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (semUp (semgid, sh->reserveLock) == -1) {
+        perror ("error on executing the up operation for semaphore reserveLock");
+        exit (EXIT_FAILURE);
+    }
 
     /* generation of intervening entities processes */                            
+    /* logger process */
+    if (sh->logCtrl.ring) {
+        sprintf (nFicErr + 6, "LG%s", errTag);
+        if ((pidLG = fork ()) < 0)  {
+            perror ("error on the fork operation for the logger");
+            exit (EXIT_FAILURE);
+        }
+        if (pidLG == 0) {
+            bindEntity ();
+            if (execl (LOGGER, LOGGER, nFic, num[1], nFicErr, NULL) < 0) {
+                perror ("error on the generation of the logger process");
+                exit (EXIT_FAILURE);
+            }
+        }
+    }
     /* agent process */
-    strcpy (nFicErr + 6, "AG");
+    sprintf (nFicErr + 6, "AG%s", errTag);
     if ((pidAG = fork ()) < 0)  {                            
         perror ("error on the fork operation for the agent");
         exit (EXIT_FAILURE);
     }
     if (pidAG == 0) {
+        bindEntity ();
         if (execl (AGENT, AGENT, nFic, num[1], nFicErr, NULL) < 0) {
             perror ("error on the generation of the agent process");
             exit (EXIT_FAILURE);
         }
     }
     /* watcher processes */
-    strcpy (nFicErr + 6, "WT");
     for (w = 0; w < NUMINGREDIENTS; w++) {           
         if ((pidWT[w] = fork ()) < 0) {
             perror ("error on the fork operation for the watcher");
             exit (EXIT_FAILURE);
         }
         sprintf(num[0],"%d",w);
-        sprintf(nFicErr+8,"%02d",w); 
-        if (pidWT[w] == 0)
+        sprintf(nFicErr+6,"WT%02d%s",w,errTag);
+        if (pidWT[w] == 0) {
+            bindEntity ();
             if (execl (WATCHER, WATCHER, num[0], nFic, num[1], nFicErr, NULL) < 0) { 
                 perror ("error on the generation of the watcher process");
                 exit (EXIT_FAILURE);
             }
+        }
     }
 
     /* smoker processes */
-    strcpy (nFicErr + 6, "SM");
     for (s = 0; s < NUMSMOKERS; s++) {           
         if ((pidSM[s] = fork ()) < 0) {
             perror ("error on the fork operation for the smoker");
             exit (EXIT_FAILURE);
         }
         sprintf(num[0],"%d",s);
-        sprintf(nFicErr+8,"%02d",s); 
-        if (pidSM[s] == 0)
+        sprintf(nFicErr+6,"SM%02d%s",s,errTag);
+        if (pidSM[s] == 0) {
+            bindEntity ();
             if (execl (SMOKER, SMOKER, num[0], nFic, num[1], nFicErr, NULL) < 0) { 
                 perror ("error on the generation of the watcher process");
                 exit (EXIT_FAILURE);
             }
+        }
     }
 
 
@@ -186,22 +892,77 @@ int main (int argc, char *argv[])
         exit (EXIT_FAILURE);
     }
 
-    /* waiting for the termination of the intervening entities processes */
+    /* waiting for the termination of the intervening entities processes; the run is stopped as soon as one of
+       them fails or, with a time limit, the state stalls */
     m = 0;
+    last = sh->fSt;
     do {
-        info = wait (&status);
+        if (stopped != 0) {
+            break;
+        }
+        if (timeout == 0) {
+            info = wait (&status);
+        }
+        else if ((info = waitpid (-1, &status, WNOHANG)) == 0) {
+            usleep (POLL * 1000);
+            if (memcmp (&last, &sh->fSt, sizeof (FULL_STAT)) != 0) {
+                last = sh->fSt;
+                still = 0;
+            }
+            else if ((still += POLL) >= 2 * timeout) {
+                fprintf (stderr, "The state did not change for %u ms!\n", still);
+                failed = true;
+                break;
+            }
+            continue;
+        }
+        if ((info == -1) && (errno == EINTR)) {
+            continue;
+        }
         if (info == -1) { 
             perror ("error on aiting for an intervening process");
             exit (EXIT_FAILURE);
         }
-        m += 1;
+        if (info != pidLG) {
+            m += 1;
+        }
+        if (!WIFEXITED (status) || (WEXITSTATUS (status) != EXIT_SUCCESS)) {
+            fprintf (stderr, "Process %d failed!\n", info);
+            failed = true;
+            break;
+        }
     } while (m < 1 + NUMINGREDIENTS + NUMSMOKERS);
+    stopRun ();
+
+    /* a stopped run leaves the log as it is and only releases the shared resources */
+    if (failed) {
+        printDiagnostics (sh, semgid);
+        shmemDettach (sh);
+        exit (EXIT_FAILURE);                                                            /* release does the rest */
+    }
+
+    /* the logger terminates once it has drained every record queued by the other entities */
+    if (pidLG != -1) {
+        closeLogRing (&sh->logRing);
+        while (waitpid (pidLG, &status, 0) == -1) {
+            if (errno != EINTR) {
+                perror ("error on waiting for the logger process");
+                exit (EXIT_FAILURE);
+            }
+            stopRun ();
+        }
+    }
+    endLog ();                                                 /* no other process writes to the log any more */
+    if (sh->instrument) {
+        printSemStats (sh);
+    }
 
     /* destruction of semaphore set and shared region */
     if (semDestroy (semgid) == -1) {
         perror ("error on destructing the semaphore set");
         exit (EXIT_FAILURE);
     }
+    semgid = -1;
     if (shmemDettach (sh) == -1) { 
         perror ("error on unmapping the shared region off the process address space");
         exit (EXIT_FAILURE);
@@ -210,6 +971,7 @@ int main (int argc, char *argv[])
         perror ("error on destructing the shared region");
         exit (EXIT_FAILURE);
     }
+    shmid = -1;
 
     return EXIT_SUCCESS;
 }
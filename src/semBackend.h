@@ -0,0 +1,57 @@
+/**
+ *  \file semBackend.h (interface file)
+ *
+ *  \brief Semaphore management.
+ *
+ *  Interface between semaphore.c and the backends that keep their semaphores in a block of shared memory
+ *  (POSIX <tt>sem_t</tt>, process-shared pthread mutex and condition variable, futex).
+ *  Each backend provides the operations on a single semaphore; semaphore.c lays the semaphores out in the block,
+ *  one per cache line, and maps the set identifiers and indices onto them.
+ */
+
+#ifndef SEMBACKEND_H_
+#define SEMBACKEND_H_
+
+#include <stddef.h>
+#include <time.h>
+
+/**
+ *  \brief Definition of <em>semaphore backend</em> data type.
+ *
+ *  Every operation returns \c 0 (<em>value</em> returns the value) upon success and -\c 1 when an error occurs (the
+ *  actual situation is reported in <tt>errno</tt>). A <em>down</em> interrupted by a signal is resumed.
+ */
+typedef struct {
+    /** \brief name of the backend, as accepted by semSelect */
+    const char *name;
+    /** \brief size of a semaphore (in bytes, at most SEM_SLOT) */
+    size_t size;
+    /** \brief initialization of a semaphore in <em>red state</em>, shared among processes */
+    int (*init) (void *sem);
+    /** \brief destruction of a semaphore (NULL when a semaphore holds nothing to release) */
+    int (*fini) (void *sem);
+    /** \brief <em>down</em> of a semaphore, failing with <tt>errno</tt> set to ETIMEDOUT if it is still blocked at
+     *         <tt>deadline</tt> (CLOCK_MONOTONIC; NULL waits forever) */
+    int (*down) (void *sem, const struct timespec *deadline);
+    /** \brief <em>down</em> of a semaphore only if it does not block (fails with <tt>errno</tt> set to EAGAIN if it
+     *         would) */
+    int (*trydown) (void *sem);
+    /** \brief <em>up</em> of a semaphore */
+    int (*up) (void *sem);
+    /** \brief value of a semaphore */
+    int (*value) (void *sem);
+} SEM_BACKEND;
+
+/** \brief room taken by each semaphore in the block (a cache line, or more for bigger objects) */
+#define  SEM_SLOT       128
+
+/** \brief POSIX unnamed semaphores backend */
+extern const SEM_BACKEND semPosixBackend;
+
+/** \brief process-shared pthread mutex and condition variable backend */
+extern const SEM_BACKEND semPthreadBackend;
+
+/** \brief futex backend */
+extern const SEM_BACKEND semFutexBackend;
+
+#endif /* SEMBACKEND_H_ */
@@ -0,0 +1,95 @@
+/**
+ *  \file semFutex.c (implementation file)
+ *
+ *  \brief Semaphore management.
+ *
+ *  Futex backend: each semaphore is an atomic counter, and the kernel is only entered when a <em>down</em> has to
+ *  block or an <em>up</em> finds processes blocked. A counter holds no kernel resources, so there is nothing to
+ *  destroy.
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "semBackend.h"
+
+/**
+ *  \brief Definition of <em>futex semaphore</em> data type.
+ */
+typedef struct {
+    /** \brief value of the semaphore (the futex word) */
+    uint32_t val;
+    /** \brief number of processes blocked, or about to block, on the semaphore */
+    uint32_t waiters;
+} FUTEX_SEM;
+
+_Static_assert (sizeof (FUTEX_SEM) <= SEM_SLOT, "futex semaphore does not fit its slot");
+
+static int futexInit (void *sem)
+{
+  FUTEX_SEM *s = sem;
+
+  s->val = 0;
+  s->waiters = 0;
+  return 0;
+}
+
+static int futexDown (void *sem, const struct timespec *deadline)
+{
+  FUTEX_SEM *s = sem;
+  uint32_t v;
+
+  while (1)
+  { v = __atomic_load_n (&s->val, __ATOMIC_RELAXED);
+    while (v > 0)                                                                         /* uncontended path */
+      if (__atomic_compare_exchange_n (&s->val, &v, v - 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+         return 0;
+    /* the waiters count is raised before checking the value again in the kernel, so an up either sees it or
+       makes the futex wait return at once */
+    __atomic_fetch_add (&s->waiters, 1, __ATOMIC_SEQ_CST);
+    /* the bitset variant takes an absolute CLOCK_MONOTONIC deadline, so spurious wake-ups do not extend it */
+    if ((syscall (SYS_futex, &s->val, FUTEX_WAIT_BITSET, 0, deadline, NULL, FUTEX_BITSET_MATCH_ANY) == -1) &&
+        (errno != EAGAIN) && (errno != EINTR))
+       { __atomic_fetch_sub (&s->waiters, 1, __ATOMIC_RELAXED);
+         return -1;
+       }
+    __atomic_fetch_sub (&s->waiters, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static int futexTrydown (void *sem)
+{
+  FUTEX_SEM *s = sem;
+  uint32_t v = __atomic_load_n (&s->val, __ATOMIC_RELAXED);
+
+  while (v > 0)
+    if (__atomic_compare_exchange_n (&s->val, &v, v - 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+       return 0;
+  errno = EAGAIN;
+  return -1;
+}
+
+static int futexUp (void *sem)
+{
+  FUTEX_SEM *s = sem;
+
+  __atomic_fetch_add (&s->val, 1, __ATOMIC_SEQ_CST);
+  if ((__atomic_load_n (&s->waiters, __ATOMIC_SEQ_CST) > 0) &&
+      (syscall (SYS_futex, &s->val, FUTEX_WAKE, 1, NULL, NULL, 0) == -1))
+     return -1;
+  return 0;
+}
+
+static int futexValue (void *sem)
+{
+  FUTEX_SEM *s = sem;
+
+  return (int) __atomic_load_n (&s->val, __ATOMIC_RELAXED);
+}
+
+/** \brief futex backend */
+const SEM_BACKEND semFutexBackend = { "futex", sizeof (FUTEX_SEM), futexInit, NULL, futexDown, futexTrydown,
+                                      futexUp, futexValue };
@@ -0,0 +1,78 @@
+/**
+ *  \file semPosix.c (implementation file)
+ *
+ *  \brief Semaphore management.
+ *
+ *  POSIX backend: each semaphore is an unnamed <tt>sem_t</tt> shared among processes.
+ */
+
+#include <errno.h>
+#include <semaphore.h>
+
+#include "semBackend.h"
+
+_Static_assert (sizeof (sem_t) <= SEM_SLOT, "POSIX semaphore does not fit its slot");
+
+static int posixInit (void *sem)
+{
+  return sem_init ((sem_t *) sem, 1, 0);
+}
+
+static int posixFini (void *sem)
+{
+  return sem_destroy ((sem_t *) sem);
+}
+
+static int posixDown (void *sem, const struct timespec *deadline)
+{
+  struct timespec mono, real;
+  int stat;
+
+  if (deadline == NULL)
+     { while (((stat = sem_wait ((sem_t *) sem)) == -1) && (errno == EINTR))
+         ;
+       return stat;
+     }
+
+  /* sem_timedwait measures the deadline on the realtime clock */
+  clock_gettime (CLOCK_MONOTONIC, &mono);
+  clock_gettime (CLOCK_REALTIME, &real);
+  real.tv_sec += deadline->tv_sec - mono.tv_sec;
+  real.tv_nsec += deadline->tv_nsec - mono.tv_nsec;
+  if (real.tv_nsec < 0)
+     { real.tv_sec -= 1;
+       real.tv_nsec += 1000000000;
+     }
+     else if (real.tv_nsec >= 1000000000)
+             { real.tv_sec += 1;
+               real.tv_nsec -= 1000000000;
+             }
+  while (((stat = sem_timedwait ((sem_t *) sem, &real)) == -1) && (errno == EINTR))
+    ;
+  return stat;
+}
+
+static int posixTrydown (void *sem)
+{
+  int stat;
+
+  while (((stat = sem_trywait ((sem_t *) sem)) == -1) && (errno == EINTR))
+    ;
+  return stat;
+}
+
+static int posixUp (void *sem)
+{
+  return sem_post ((sem_t *) sem);
+}
+
+static int posixValue (void *sem)
+{
+  int val;
+
+  return (sem_getvalue ((sem_t *) sem, &val) == -1) ? -1 : val;
+}
+
+/** \brief POSIX unnamed semaphores backend */
+const SEM_BACKEND semPosixBackend = { "posix", sizeof (sem_t), posixInit, posixFini, posixDown, posixTrydown,
+                                      posixUp, posixValue };
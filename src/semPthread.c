@@ -0,0 +1,133 @@
+/**
+ *  \file semPthread.c (implementation file)
+ *
+ *  \brief Semaphore management.
+ *
+ *  Pthread backend: each semaphore is a counter protected by a process-shared mutex, with a process-shared
+ *  condition variable where the <em>down</em> operations block.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+
+#include "semBackend.h"
+
+/**
+ *  \brief Definition of <em>pthread semaphore</em> data type.
+ */
+typedef struct {
+    /** \brief access to the counter */
+    pthread_mutex_t mutex;
+    /** \brief processes waiting for a positive counter */
+    pthread_cond_t positive;
+    /** \brief value of the semaphore */
+    unsigned int val;
+} PTHREAD_SEM;
+
+_Static_assert (sizeof (PTHREAD_SEM) <= SEM_SLOT, "pthread semaphore does not fit its slot");
+
+/* pthread functions return the error code instead of setting errno */
+static int check (int stat)
+{
+  if (stat != 0)
+     { errno = stat;
+       return -1;
+     }
+  return 0;
+}
+
+static int pthreadInit (void *sem)
+{
+  PTHREAD_SEM *s = sem;
+  pthread_mutexattr_t mAttr;
+  pthread_condattr_t cAttr;
+  int stat;
+
+  if ((check (pthread_mutexattr_init (&mAttr)) == -1) ||
+      (check (pthread_mutexattr_setpshared (&mAttr, PTHREAD_PROCESS_SHARED)) == -1))
+     return -1;
+  stat = check (pthread_mutex_init (&s->mutex, &mAttr));
+  pthread_mutexattr_destroy (&mAttr);
+  if (stat == -1)
+     return -1;
+
+  if ((check (pthread_condattr_init (&cAttr)) == -1) ||
+      (check (pthread_condattr_setpshared (&cAttr, PTHREAD_PROCESS_SHARED)) == -1) ||
+      (check (pthread_condattr_setclock (&cAttr, CLOCK_MONOTONIC)) == -1))
+     return -1;
+  stat = check (pthread_cond_init (&s->positive, &cAttr));
+  pthread_condattr_destroy (&cAttr);
+  s->val = 0;
+  return stat;
+}
+
+static int pthreadFini (void *sem)
+{
+  PTHREAD_SEM *s = sem;
+
+  if (check (pthread_cond_destroy (&s->positive)) == -1)
+     return -1;
+  return check (pthread_mutex_destroy (&s->mutex));
+}
+
+static int pthreadDown (void *sem, const struct timespec *deadline)
+{
+  PTHREAD_SEM *s = sem;
+
+  if (check (pthread_mutex_lock (&s->mutex)) == -1)
+     return -1;
+  while (s->val == 0)
+    if (check ((deadline == NULL) ? pthread_cond_wait (&s->positive, &s->mutex)
+                                  : pthread_cond_timedwait (&s->positive, &s->mutex, deadline)) == -1)
+       { pthread_mutex_unlock (&s->mutex);
+         return -1;
+       }
+  s->val -= 1;
+  return check (pthread_mutex_unlock (&s->mutex));
+}
+
+static int pthreadTrydown (void *sem)
+{
+  PTHREAD_SEM *s = sem;
+  int stat = 0;
+
+  if (check (pthread_mutex_lock (&s->mutex)) == -1)
+     return -1;
+  if (s->val > 0)
+     s->val -= 1;
+     else { errno = EAGAIN;
+            stat = -1;
+          }
+  if (check (pthread_mutex_unlock (&s->mutex)) == -1)
+     return -1;
+  return stat;
+}
+
+static int pthreadUp (void *sem)
+{
+  PTHREAD_SEM *s = sem;
+
+  if (check (pthread_mutex_lock (&s->mutex)) == -1)
+     return -1;
+  s->val += 1;
+  if (check (pthread_cond_signal (&s->positive)) == -1)
+     { pthread_mutex_unlock (&s->mutex);
+       return -1;
+     }
+  return check (pthread_mutex_unlock (&s->mutex));
+}
+
+static int pthreadValue (void *sem)
+{
+  PTHREAD_SEM *s = sem;
+  int val;
+
+  if (check (pthread_mutex_lock (&s->mutex)) == -1)
+     return -1;
+  val = (int) s->val;
+  return (check (pthread_mutex_unlock (&s->mutex)) == -1) ? -1 : val;
+}
+
+/** \brief process-shared pthread mutex and condition variable backend */
+const SEM_BACKEND semPthreadBackend = { "pthread", sizeof (PTHREAD_SEM), pthreadInit, pthreadFini, pthreadDown,
+                                        pthreadTrydown, pthreadUp, pthreadValue };
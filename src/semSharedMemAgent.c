@@ -31,6 +31,7 @@
 #include "sharedDataSync.h"
 #include "semaphore.h"
 #include "sharedMemory.h"
+#include "sharedLocks.h"
 
 
 /** \brief logging file name */
@@ -45,7 +46,7 @@ static int semgid;
 /** \brief pointer to shared memory region */
 static SHARED_DATA *sh;
 
-static void prepareIngredients ();
+static void prepareIngredients (int order);
 static void waitForCigarette ();
 static void closeFactory ();
 
@@ -72,7 +73,7 @@ int main (int argc, char *argv[])
     }
     strcpy (nFic, argv[1]);
     key = (unsigned int) strtol (argv[2], &tinp, 0);
-    if (*tinp != '\0') {
+    if ((*tinp != '\0') && (shmemImport (tinp) == -1)) {                /* a shared memory file follows the key */
         fprintf (stderr, "Error on the access key communication!\n");
         return EXIT_FAILURE;
     }
@@ -92,14 +93,28 @@ int main (int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    /* adaptive locking of the critical regions */
+    if ((sh->spin > 0) && (spinRegion (sh) == -1)) {
+        perror ("error on enabling adaptive locking of semaphore access");
+        return EXIT_FAILURE;
+    }
+    semTimeout (sh->timeout);                                                 /* a stalled run fails instead of hanging */
+    if (sh->instrument && (semInstrument (sh->semStats[LOG_AGENT], SEM_NU) == -1)) {
+        perror ("error on instrumenting the semaphore operations");
+        return EXIT_FAILURE;
+    }
+
+    /* opening the log once for the whole life cycle */
+    logAttach (nFic, &sh->logCtrl, &sh->logRing, LOG_AGENT);
+
     /* initialize random generator */
-    srandom ((unsigned int) getpid ());                                      
+    srandom ((sh->seed != 0) ? sh->seed + LOG_AGENT : (unsigned int) getpid ());
 
     /* simulation of the life cycle of the agent */
 
     int nOrders=0;
     while(nOrders < sh->fSt.nOrders) {
-       prepareIngredients();
+       prepareIngredients(nOrders);
        waitForCigarette();
 
        nOrders++;
@@ -107,6 +122,8 @@ int main (int argc, char *argv[])
 
     closeFactory();
 
+    flushLog ();                            /* a rotated log needs the shared control block to write the last records */
+
     /* unmapping the shared region off the process address space */
 
     if (shmemDettach (sh) == -1) { 
@@ -122,47 +139,53 @@ int main (int argc, char *argv[])
  *
  *  The agent updates state and randomly selects a pack of 2 different ingredients to be generated.
  *  The inventory is updated to new existences of ingredients.
- *  Both ingredients generated should be notified to watcher using different semaphores. 
+ *  Both ingredients generated should be notified to watcher using different semaphores, or, with the delivery
+ *  rings, pushed to the rings of the watchers after leaving the critical region.
+ *
+ *  \param order number of the order
  */
-static void prepareIngredients ()
+static void prepareIngredients (int order)
 {
-
-
-    if (semDown (semgid, sh->mutex) == -1) {                                                      /* enter critical region */
-        perror ("error on the up operation for semaphore access (AG)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    //Set state to preparing
-    sh->fSt.st.agentStat=(unsigned int)PREPARING;
     //Generate two random ingredients
     int i1, i2;
     i1=random()%3;
     do{
         i2=random()%3;
     }while(i1==i2);
-    sh->fSt.ingredients[i1]+=1;
-    sh->fSt.ingredients[i2]+=1;
-    saveState(nFic,&sh->fSt);
     /* End Code */
 
+    lockRegion (semgid, sh, LOCK_ING (i1) | LOCK_ING (i2), "AG");                               /* enter critical region */
+
+    /* Start Code */
+    //Set state to preparing
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.agentStat, PREPARING);
+    SLOT (sh->fSt.ingredients[i1])+=1;
+    SLOT (sh->fSt.ingredients[i2])+=1;
+    endUpdate ();
+    saveState(nFic,&sh->fSt);
+    /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                        /* leave critical region */
-        perror ("error on the up operation for semaphore access (AG)");
-        exit (EXIT_FAILURE);
-    }
 
     /* Start Code */
-    //Wake up the Watchers corersponding to the generated ingredients
-    if (semUp (semgid, sh->ingredient[i1]) == -1) {                                                      
-        perror ("error on the up operation for semaphore ingredient[] (AG)");
+    //Leave the critical region and wake up the Watchers corersponding to the generated ingredients
+    SEM_OP ups[LOCK_MAXOPS + 2];
+    unsigned int n = unlockOps (sh, LOCK_ING (i1) | LOCK_ING (i2), ups);
+
+    if (!sh->rings) {
+        ups[n++] = (SEM_OP) { sh->ingredient[i1], 1 };
+        ups[n++] = (SEM_OP) { sh->ingredient[i2], 1 };
+    }
+    if (semUpMany (semgid, ups, n) == -1) {                                                       /* leave critical region */
+        perror ("error on the up operation for semaphores access and ingredient[] (AG)");
         exit (EXIT_FAILURE);
     }
-    if (semUp (semgid, sh->ingredient[i2]) == -1) {                                                      
-        perror ("error on the up operation for semaphore ingredient[] (AG)");
+    if (sh->rings && ((ringDeliver (semgid, &sh->delivery[i1], order, i1) == -1) ||
+                      (ringDeliver (semgid, &sh->delivery[i2], order, i2) == -1))) {
+        perror ("error on the delivery of the ingredients (AG)");
         exit (EXIT_FAILURE);
-    }    
+    }
     /* End Code */
 }
 
@@ -174,22 +197,14 @@ static void prepareIngredients ()
  */
 static void waitForCigarette ()
 {
-    if (semDown (semgid, sh->mutex) == -1) {                                                      /* enter critical region */
-        perror ("error on the down operation for semaphore access (AG)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    //Set state to waiting
-    sh->fSt.st.agentStat=(unsigned int)WAITING_CIG;
+    //Set state to waiting (the state alone needs no critical region)
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.agentStat, WAITING_CIG);
+    endUpdate ();
     saveState(nFic,&sh->fSt);
     /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                        /* leave critical region */
-        perror ("error on the up operation for semaphore access (AG)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
     //Wait for smoker to finish rolling
     if (semDown (semgid, sh->waitCigarette) == -1) {                                                      
@@ -206,28 +221,32 @@ static void waitForCigarette ()
  */
 static void closeFactory ()
 {
-    if (semDown (semgid, sh->mutex) == -1) {                                                      /* enter critical region */
-        perror ("error on the up operation for semaphore access (AG)");
-        exit (EXIT_FAILURE);
-    }
+    lockRegion (semgid, sh, LOCK_RESERVE, "AG");                                                /* enter critical region */
 
     /* Start Code */
     //Set state to closing
-    sh->fSt.st.agentStat=(unsigned int)CLOSING_A;
-    sh->fSt.closing=true;
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.agentStat, CLOSING_A);
+    __atomic_store_n (&sh->fSt.closing, true, __ATOMIC_RELEASE);
+    endUpdate ();
     saveState(nFic,&sh->fSt);
     /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                        /* leave critical region */
-        perror ("error on the up operation for semaphore access (AG)");
+    /* Start Code */
+    //Leave the critical region and wake up all Watchers
+    SEM_OP ups[LOCK_MAXOPS + NUMINGREDIENTS];
+    unsigned int n = unlockOps (sh, LOCK_RESERVE, ups);
+
+    for(int i=0;(i<3)&&!sh->rings;i++){
+        ups[n++] = (SEM_OP) { sh->ingredient[i], 1 };
+    }
+    if (semUpMany (semgid, ups, n) == -1) {                                                       /* leave critical region */
+        perror ("error on the up operation for semaphores access and ingredient[] (AG)");
         exit (EXIT_FAILURE);
     }
-
-    /* Start Code */
-    //Wake up all Watchers
-    for(int i=0;i<3;i++){
-        if (semUp (semgid, sh->ingredient[i]) == -1) {                                                      
-            perror ("error on the up operation for semaphore ingredient[] (AG)");
+    for(int i=0;(i<3)&&sh->rings;i++){
+        if (ringWake (semgid, &sh->delivery[i]) == -1) {
+            perror ("error on waking up the watchers (AG)");
             exit (EXIT_FAILURE);
         }
     }
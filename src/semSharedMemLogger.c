@@ -0,0 +1,112 @@
+/**
+ *  \file semSharedMemLogger.c (implementation file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Synchronization based on semaphores and shared memory.
+ *  Implementation with SVIPC.
+ *
+ *  Definition of the operations carried out by the logger:
+ *     \li draining the ring of records queued by the other entities into the logging file.
+ *
+ *  The logger is only generated when the ring is enabled. It never takes any semaphore, so the disk latency
+ *  is kept off the synchronization path of the agent, watchers and smokers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <string.h>
+#include <sched.h>
+
+#include "probConst.h"
+#include "probDataStruct.h"
+#include "logging.h"
+#include "sharedDataSync.h"
+#include "sharedMemory.h"
+
+/** \brief number of empty polls of the ring before the logger starts sleeping */
+#define  SPINPOLLS      100
+
+/** \brief sleeping time between polls of an idle ring (in us) */
+#define  POLLSLEEP      50
+
+/** \brief logging file name */
+static char nFic[51];
+
+/** \brief shared memory block access identifier */
+static int shmid;
+
+/** \brief pointer to shared memory region */
+static SHARED_DATA *sh;
+
+/**
+ *  \brief Main program.
+ *
+ *  Its role is to generate the life cycle of the logger, which lasts until the ring is closed by the main process.
+ */
+int main (int argc, char *argv[])
+{
+    int key;                                          /*access key to shared memory and semaphore set */
+    char *tinp;                                                     /* numerical parameters test flag */
+    unsigned int idle = 0;                                                 /* number of empty polls */
+
+    /* validation of command line parameters */
+
+    if (argc != 4) {
+        freopen ("error_LG", "a", stderr);
+        fprintf (stderr, "Number of parameters is incorrect!\n");
+        return EXIT_FAILURE;
+    }
+    else {
+       freopen (argv[3], "w", stderr);
+       setbuf(stderr,NULL);
+    }
+    strcpy (nFic, argv[1]);
+    key = (unsigned int) strtol (argv[2], &tinp, 0);
+    if ((*tinp != '\0') && (shmemImport (tinp) == -1)) {                /* a shared memory file follows the key */
+        fprintf (stderr, "Error on the access key communication!\n");
+        return EXIT_FAILURE;
+    }
+
+    /* connection to the shared memory region and mapping the shared region onto the process address space */
+    if ((shmid = shmemConnect (key)) == -1) {
+        perror ("error on connecting to the shared memory region");
+        return EXIT_FAILURE;
+    }
+    if (shmemAttach (shmid, (void **) &sh) == -1) {
+        perror ("error on mapping the shared region on the process address space");
+        return EXIT_FAILURE;
+    }
+
+    logAttach (nFic, &sh->logCtrl, &sh->logRing, LOG_LOGGER);
+
+    /* simulation of the life cycle of the logger */
+
+    while (true) {
+        if (drainLog () > 0) {
+            idle = 0;
+            continue;
+        }
+        if (__atomic_load_n (&sh->logRing.closed, __ATOMIC_ACQUIRE)) {
+            drainLog ();                                        /* records queued before the ring was closed */
+            break;
+        }
+        if (++idle < SPINPOLLS) {
+            sched_yield ();
+        }
+        else usleep (POLLSLEEP);
+    }
+    flushLog ();
+
+    /* unmapping the shared region off the process address space */
+
+    if (shmemDettach (sh) == -1) {
+        perror ("error on unmapping the shared region off the process address space");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
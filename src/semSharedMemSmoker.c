@@ -28,6 +28,7 @@
 #include "sharedDataSync.h"
 #include "semaphore.h"
 #include "sharedMemory.h"
+#include "sharedLocks.h"
 
 /** \brief logging file name */
 static char nFic[51];
@@ -75,7 +76,7 @@ int main (int argc, char *argv[])
     }
     strcpy (nFic, argv[2]);
     key = (unsigned int) strtol (argv[3], &tinp, 0);
-    if (*tinp != '\0') { 
+    if ((*tinp != '\0') && (shmemImport (tinp) == -1)) {                /* a shared memory file follows the key */
         fprintf (stderr, "Error on the access key communication!\n");
         return EXIT_FAILURE;
     }
@@ -95,8 +96,22 @@ int main (int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    /* adaptive locking of the critical regions */
+    if ((sh->spin > 0) && (spinRegion (sh) == -1)) {
+        perror ("error on enabling adaptive locking of semaphore access");
+        return EXIT_FAILURE;
+    }
+    semTimeout (sh->timeout);                                                 /* a stalled run fails instead of hanging */
+    if (sh->instrument && (semInstrument (sh->semStats[LOG_SMOKER (n)], SEM_NU) == -1)) {
+        perror ("error on instrumenting the semaphore operations");
+        return EXIT_FAILURE;
+    }
+
+    /* opening the log once for the whole life cycle */
+    logAttach (nFic, &sh->logCtrl, &sh->logRing, LOG_SMOKER (n));
+
     /* initialize random generator */
-    srandom ((unsigned int) getpid ());                                                 
+    srandom ((sh->seed != 0) ? sh->seed + LOG_SMOKER (n) : (unsigned int) getpid ());
 
 
     /* simulation of the life cycle of the smoker */
@@ -105,6 +120,8 @@ int main (int argc, char *argv[])
         smoke(n);
     }
 
+    flushLog ();                            /* a rotated log needs the shared control block to write the last records */
+
     /* unmapping the shared region off the process address space */
     if (shmemDettach (sh) == -1) {
         perror ("error on unmapping the shared region off the process address space");
@@ -151,22 +168,14 @@ static bool waitForIngredients (int id)
 {
     bool ret = true;
 
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    //Set the state to waiting to ingredients 
-    sh->fSt.st.smokerStat[id]=(unsigned int)WAITING_2ING;
+    //Set the state to waiting to ingredients (the state alone needs no critical region)
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.smokerStat[id], WAITING_2ING);
+    endUpdate ();
     saveState(nFic, &sh->fSt);
     /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
     if (semDown (semgid, sh->wait2Ings[id]) == -1)  {                                                     
         perror ("error on the up operation for semaphore wait2Ings (SM)");
@@ -174,30 +183,36 @@ static bool waitForIngredients (int id)
     }
     /* End Code */
 
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    if(sh->fSt.closing){
-        ret=false;
+    //closing was set before the up that woke the smoker, so it is read without entering the critical region
+    if(__atomic_load_n (&sh->fSt.closing, __ATOMIC_ACQUIRE)){
         //Set the state to closing 
-        sh->fSt.st.smokerStat[id]=(unsigned int)CLOSING_S;
+        beginUpdate ();
+        SET_STAT (sh->fSt.st.smokerStat[id], CLOSING_S);
+        endUpdate ();
+        saveState(nFic,&sh->fSt);
+        return false;
     }
-    else {
-        for(int n=0;n<3;n++){
-            if(id!=n)
-                sh->fSt.ingredients[n]-=1;
-        }
+    /* End Code */
+
+    unsigned int set = 0;                                                    /* locks of the ingredients taken */
+
+    for(int n=0;n<3;n++){
+        if(id!=n) set |= LOCK_ING (n);
     }
+    lockRegion (semgid, sh, set, "SM");                                                         /* enter critical region */
+
+    /* Start Code */
+    beginUpdate ();
+    for(int n=0;n<3;n++){
+        if(id!=n)
+            SLOT (sh->fSt.ingredients[n])-=1;
+    }
+    endUpdate ();
     saveState(nFic,&sh->fSt);
     /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
+    unlockRegion (semgid, sh, set, "SM");                                                        /* exit critical region */
 
     return ret;
 }
@@ -214,26 +229,19 @@ static void rollingCigarette (int id)
 {
     double rollingTime = 100.0 + normalRand(30.0);
 
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    //Set the state to rolling 
-    sh->fSt.st.smokerStat[id]=(unsigned int)ROLLING;
+    //Set the state to rolling (the state alone needs no critical region)
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.smokerStat[id], ROLLING);
+    endUpdate ();
     saveState(nFic, &sh->fSt);
 
     //The smoker takes some time to roll the cigarette 
     if(rollingTime>0.0) usleep(rollingTime);
     /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
-    
     /* Start Code */
+    //Let the agent know the cigarette is rolled
     if (semUp (semgid, sh->waitCigarette) == -1)  {                                                     
         perror ("error on the up operation for semaphore waitCigarette (SM)");
         exit (EXIT_FAILURE);
@@ -246,35 +254,36 @@ static void rollingCigarette (int id)
  *  \brief smoker smokes
  *
  *  The smoker updates state and the number of cigarretes already smoked and 
- *  takes some time to smoke the cigarette
+ *  takes some time to smoke the cigarette. The smoking time is spent outside the critical region, so that the
+ *  other entities go on meanwhile; only the counter update is locked.
  *
  *  \param id smoker id
  */
 static void smoke(int id)
 {
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    //Set the state to smoking 
-    sh->fSt.st.smokerStat[id]=(unsigned int)SMOKING;
+    //Set the state to smoking (the state alone needs no critical region)
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.smokerStat[id], SMOKING);
+    endUpdate ();
     saveState(nFic, &sh->fSt);
 
     //The smoker takes some time to smoke the cigarette
     double smokingTime = 100.0 + normalRand(30.0); 
     if(smokingTime>0.0) usleep(smokingTime);
+    /* End Code */
 
+    lockRegion (semgid, sh, 0, "SM");                                                           /* enter critical region */
+
+    /* Start Code */
     //Updates the number of smoked cigarettes
-    sh->fSt.nCigarettes[id]+=1;
+    beginUpdate ();
+    SLOT (sh->fSt.nCigarettes[id])+=1;
+    endUpdate ();
     saveState(nFic, &sh->fSt);
     /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (SM)");
-        exit (EXIT_FAILURE);
-    }
+    unlockRegion (semgid, sh, 0, "SM");                                                          /* exit critical region */
 
     /* TODO: insert your code here */
 
@@ -29,6 +29,7 @@
 #include "sharedDataSync.h"
 #include "semaphore.h"
 #include "sharedMemory.h"
+#include "sharedLocks.h"
 
 /** \brief logging file name */
 static char nFic[51];
@@ -79,7 +80,7 @@ int main (int argc, char *argv[])
     }
     strcpy (nFic, argv[2]);
     key = (unsigned int) strtol (argv[3], &tinp, 0);
-    if (*tinp != '\0') {
+    if ((*tinp != '\0') && (shmemImport (tinp) == -1)) {                /* a shared memory file follows the key */
         fprintf (stderr, "Error on the access key communication!\n");
         return EXIT_FAILURE;
     }
@@ -99,8 +100,22 @@ int main (int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    /* adaptive locking of the critical regions */
+    if ((sh->spin > 0) && (spinRegion (sh) == -1)) {
+        perror ("error on enabling adaptive locking of semaphore access");
+        return EXIT_FAILURE;
+    }
+    semTimeout (sh->timeout);                                                 /* a stalled run fails instead of hanging */
+    if (sh->instrument && (semInstrument (sh->semStats[LOG_WATCHER (n)], SEM_NU) == -1)) {
+        perror ("error on instrumenting the semaphore operations");
+        return EXIT_FAILURE;
+    }
+
+    /* opening the log once for the whole life cycle */
+    logAttach (nFic, &sh->logCtrl, &sh->logRing, LOG_WATCHER (n));
+
     /* initialize random generator */
-    srandom ((unsigned int) getpid ());              
+    srandom ((sh->seed != 0) ? sh->seed + LOG_WATCHER (n) : (unsigned int) getpid ());
 
     /* simulation of the life cycle of the watcher */
     int id = n, smokerReady;
@@ -109,6 +124,8 @@ int main (int argc, char *argv[])
         if(smokerReady>=0) informSmoker(id, smokerReady);
     }
 
+    flushLog ();                            /* a rotated log needs the shared control block to write the last records */
+
     /* unmapping the shared region off the process address space */
     if (shmemDettach (sh) == -1) {
         perror ("error on unmapping the shared region off the process address space");
@@ -122,6 +139,7 @@ int main (int argc, char *argv[])
  *  \brief watcher waits for ingredient generated by agent
  *
  *  Watcher updates state and waits for ingredient from agent, then checks agent is closing.
+ *  With the delivery rings, the watcher collects the next ingredient from its ring and only waits when it is empty.
  *  If agent is closing, watcher should update state again and inform the smoker that holds 
  *  the ingredient of the watcher so that it can terminate.
  *  The internal state should be saved.
@@ -133,57 +151,49 @@ int main (int argc, char *argv[])
 static bool waitForIngredient(int id)
 {
     bool ret=true;
+    DELIVERY desc;                                                                    /* ingredient collected */
+    int got = 1;                                                 /* an ingredient was collected from the ring */
     
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    //Set state to waiting
-    sh->fSt.st.watcherStat[id]=(unsigned int)WAITING_ING;
+    //Set state to waiting (the state alone needs no critical region)
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.watcherStat[id], WAITING_ING);
+    endUpdate ();
     saveState(nFic,&sh->fSt);
     /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
     //Wait to be released by Agent
-    if (semDown (semgid, sh->ingredient[id]) == -1)  {                                                  
+    if (sh->rings) {
+        if ((got = ringCollect (semgid, &sh->delivery[id], &sh->fSt.closing, &desc)) == -1) {
+            perror ("error on the collection of an ingredient (WT)");
+            exit (EXIT_FAILURE);
+        }
+        assert ((got == 0) || (desc.ingredient == (unsigned int) id));
+    }
+    else if (semDown (semgid, sh->ingredient[id]) == -1)  {                                                  
         perror ("error on the down operation for semaphore ingredient (WT)");
         exit (EXIT_FAILURE);
     }
     /* End Code */
 
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
-    }
-
     /* Start Code */
-    //Check if agent is closing the factory
-    if(sh->fSt.closing){
+    //Check if agent is closing the factory; closing was set before the up that woke the watcher, so it is read
+    //without entering the critical region (a ring is only found empty and closed once every ingredient is collected)
+    if(sh->rings ? (got == 0) : __atomic_load_n (&sh->fSt.closing, __ATOMIC_ACQUIRE)){
         ret=false;
-        sh->fSt.st.watcherStat[id]=(unsigned int)CLOSING_W;
+        beginUpdate ();
+        SET_STAT (sh->fSt.st.watcherStat[id], CLOSING_W);
+        endUpdate ();
         saveState(nFic,&sh->fSt);
-    }
-    /* End Code */
 
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
-    }
-
-    //Notify smoker if factory is closing
-    if(ret==false){
+        //Notify smoker that the factory is closing
         if (semUp (semgid, sh->wait2Ings[id]) == -1)  {
             perror ("error on the up operation (in Watcher) to free Smoker");
             exit (EXIT_FAILURE);
         }
     }
+    /* End Code */
 
     return ret;
 
@@ -194,6 +204,8 @@ static bool waitForIngredient(int id)
  *
  *  Watcher updates state and reserves ingredient and then checks if some smoker may start rolling a cigarette.
  *  If a smoker may start rolling, then this smoker id is returned.
+ *  Only the lock of the ingredient of the watcher is taken, so watchers reserve in parallel; the other
+ *  reservations are read atomically.
  *
  *  \param id watcher id
  * 
@@ -204,22 +216,27 @@ static int updateReservations (int id)
 {
     int ret = -1;
 
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
-    }
+    lockRegion (semgid, sh, LOCK_ING (id), "WT");                                               /* enter critical region */
 
     /* Start Code */
     //Set state to updating
-    sh->fSt.st.watcherStat[id]=(unsigned int)UPDATING;
+    beginUpdate ();
+    SET_STAT (sh->fSt.st.watcherStat[id], UPDATING);
     //Update reserved ingredients
-    sh->fSt.reserved[id]+=1;
+    __atomic_add_fetch (&SLOT (sh->fSt.reserved[id]), 1, __ATOMIC_SEQ_CST);
+    endUpdate ();
     saveState(nFic,&sh->fSt);
+    /* End Code */
+
+    unlockRegion (semgid, sh, LOCK_ING (id), "WT");                                              /* exit critical region */
 
-    //Check reserved ingredients so some smoker can start rolling a cigarette
+    /* Start Code */
+    //Check reserved ingredients so some smoker can start rolling a cigarette; the reservation was published
+    //before the others are read, so of two watchers reserving at once at least one sees the match (it is
+    //checked again by informSmoker)
     int k=0,j=0;
     for(int i=0;i<3;i++){
-        if(sh->fSt.reserved[i]>0) {
+        if(__atomic_load_n (&SLOT (sh->fSt.reserved[i]), __ATOMIC_SEQ_CST)>0) {
             j+=i;
             k+=1;
         }
@@ -230,11 +247,6 @@ static int updateReservations (int id)
         if(j==3) ret=0;
     }
     /* End Code */
-    
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
-    }
 
     return ret;
 }
@@ -243,6 +255,8 @@ static int updateReservations (int id)
  *  \brief watcher informs smoker that he can use the available ingredients to roll cigarette
  *
  * The watcher updates its state and notifies smoker that he may start rolling cigarette.  
+ * Only the reservation lock is taken: it makes the consumption of the two reservations a single step, and the
+ * smoker is only notified if no other watcher consumed them first.
  *
  *  \param id watcher id
  *  \param smokerReady  id of smoker that may start rolling
@@ -250,30 +264,36 @@ static int updateReservations (int id)
 
 static void informSmoker (int id, int smokerReady)
 {
-    if (semDown (semgid, sh->mutex) == -1)  {                                                     /* enter critical region */
-        perror ("error on the up operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
-    }
+    bool ready = true;                                               /* both reservations are still available */
+
+    lockRegion (semgid, sh, LOCK_RESERVE, "WT");                                                /* enter critical region */
 
     /* Start Code */
-    //Set state to informing
-    sh->fSt.st.watcherStat[id]=(unsigned int)INFORMING;
-    //Update reserved ingredients
+    //Another watcher may have seen the same match and consumed the reservations first
     for(int i=0;i<3;i++){
-        if(smokerReady!=i) sh->fSt.reserved[i]-=1;
+        if((smokerReady!=i) && (__atomic_load_n (&SLOT (sh->fSt.reserved[i]), __ATOMIC_SEQ_CST)==0)) ready=false;
     }
-    saveState(nFic,&sh->fSt);
-    /* End Code */
-
-    if (semUp (semgid, sh->mutex) == -1) {                                                         /* exit critical region */
-        perror ("error on the down operation for semaphore access (WT)");
-        exit (EXIT_FAILURE);
+    if(ready){
+        //Set state to informing
+        beginUpdate ();
+        SET_STAT (sh->fSt.st.watcherStat[id], INFORMING);
+        //Update reserved ingredients
+        for(int i=0;i<3;i++){
+            if(smokerReady!=i) __atomic_sub_fetch (&SLOT (sh->fSt.reserved[i]), 1, __ATOMIC_SEQ_CST);
+        }
+        endUpdate ();
+        saveState(nFic,&sh->fSt);
     }
+    /* End Code */
 
     /* Start Code */
-    //If smoker has enough ingredients, wake him up
-    if (semUp (semgid, sh->wait2Ings[smokerReady]) == -1) {
-        perror ("error on the up opperation for semaphore wait2Ings (WT)");
+    //Exit the critical region and wake up the smoker, who has enough ingredients
+    SEM_OP ups[LOCK_MAXOPS + 1];
+    unsigned int n = unlockOps (sh, LOCK_RESERVE, ups);
+
+    if(ready) ups[n++] = (SEM_OP) { sh->wait2Ings[smokerReady], 1 };
+    if (semUpMany (semgid, ups, n) == -1) {                                                        /* exit critical region */
+        perror ("error on the up opperation for semaphores access and wait2Ings (WT)");
         exit (EXIT_FAILURE);
     }
     /* End Code */
@@ -8,21 +8,348 @@
  *     \li connection to a previously created set of semaphores
  *     \li destruction of a previously created set of semaphores
  *     \li signalling start of operations
- *     \li <em>down</em> of a semaphore within the set
- *     \li <em>up</em> of a semaphore within the set.
+ *     \li <em>down</em> of a semaphore within the set, optionally spinning before it blocks or with a time limit
+ *     \li <em>up</em> of a semaphore within the set
+ *     \li <em>up</em> of several semaphores within the set at once
+ *     \li reading the value of a semaphore within the set
+ *     \li instrumentation of the operations of the calling process
+ *     \li selection of the backend.
+ *
+ *  The semaphores are SysV semaphores (backend "sysv"), or are kept in a SysV shared memory block by one of the
+ *  backends declared in semBackend.h ("posix", "pthread" or "futex"). The block's key is the one <tt>ftok</tt>
+ *  gives for project 's' on the same file as <tt>key</tt> (the low 24 bits of <tt>key</tt> under project 's'), and
+ *  its first slot records the backend, so the processes that connect to the set find out which one was selected by
+ *  the process that created it.
+ *  The default backend is set at build time (make SEM=name); a process may select another one before creating a set.
  *
  *  \author António Rui Borges - October 1995
  */
 
+#define _GNU_SOURCE                                                                                  /* semtimedop */
+
 #include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/sem.h>
+#include <sys/shm.h>
 #include <assert.h>
 
+#include "semaphore.h"
+#include "semBackend.h"
+
 /** \brief access permission: user r-w */
 #define  MASK           0600
 
+/** \brief project id of the key of the block of semaphores */
+#define  SEMPROJ        's'
+
+/** \brief number of semaphores a process may spin on or instrument (indices 1 .. SEM_LOCAL-1) */
+#define  SEM_LOCAL      64
+
+/** \brief lowest spin budget, kept so that a lock whose holders got slow for a while may turn out fast again */
+#define  SEM_SPINMIN    16
+
+/** \brief backend selected when none is (make SEM=name) */
+#ifndef SEM_DEFAULT
+#define  SEM_DEFAULT    "sysv"
+#endif
+
+/**
+ *  \brief Definition of <em>block of semaphores</em> header data type (first slot of the block).
+ */
+typedef struct {
+    /** \brief backend (index in backends) */
+    unsigned int backend;
+    /** \brief number of semaphores in the set (including the start of operations one) */
+    unsigned int snum;
+} SEM_BLOCK;
+
+/** \brief backends; the first one (SysV) is implemented here */
+static const SEM_BACKEND *backends[] = { NULL, &semPosixBackend, &semPthreadBackend, &semFutexBackend };
+
+/** \brief number of backends */
+#define  NBACKENDS      (sizeof (backends) / sizeof (backends[0]))
+
+/** \brief backend of the sets created by the calling process (NBACKENDS while none was selected) */
+static unsigned int selected = NBACKENDS;
+
+/** \brief identifier of the block of semaphores the calling process is attached to */
+static int blockId = -1;
+
+/** \brief block of semaphores the calling process is attached to */
+static SEM_BLOCK *block = NULL;
+
+/** \brief backend of the block of semaphores the calling process is attached to */
+static const SEM_BACKEND *ops = NULL;
+
+/**
+ *  \brief Definition of <em>spinning down</em> data type (state of an adaptive lock in the calling process).
+ */
+typedef struct {
+    /** \brief maximum number of tries before blocking (0: the down blocks at once) */
+    unsigned int limit;
+    /** \brief number of tries of the next down */
+    unsigned int budget;
+    /** \brief running average of the tries taken by the downs that succeeded while spinning */
+    unsigned int avg;
+} SEM_SPIN;
+
+/** \brief adaptive locks of the calling process */
+static SEM_SPIN spin[SEM_LOCAL];
+
+/** \brief longest time a down of the calling process may block (ms, 0: no limit) */
+static unsigned int timeout = 0;
+
+/** \brief statistics of the calling process (one entry per semaphore, from index 1), NULL when not instrumented */
+static SEM_USAGE *stats = NULL;
+
+/** \brief number of entries in stats */
+static unsigned int statsNum = 0;
+
+/** \brief instant each semaphore was last acquired by the calling process (ns, 0 when not held) */
+static uint64_t since[SEM_LOCAL];
+
+/** \brief hint to the processor that the caller is busy waiting */
+#if defined (__x86_64__) || defined (__i386__)
+#define  cpuRelax()     __builtin_ia32_pause ()
+#elif defined (__aarch64__)
+#define  cpuRelax()     __asm__ __volatile__ ("yield" ::: "memory")
+#else
+#define  cpuRelax()     ((void) 0)
+#endif
+
+/* internal functions */
+
+/* key of the block of semaphores: the low 24 bits of the key of the set, under the project id SEMPROJ; the keys
+   used must therefore differ in those bits (the main program gives every key the same first byte, as ftok) */
+static key_t blockKey (int key)
+{
+  return (key_t) (((unsigned int) key & 0x00FFFFFF) | ((unsigned int) SEMPROJ << 24));
+}
+
+static void *blockSem (unsigned int sindex)
+{
+  return (char *) block + SEM_SLOT * (1 + sindex);
+}
+
+static int blockAttach (int semgid)
+{
+  void *p;
+
+  if ((p = shmat (semgid, NULL, 0)) == (void *) -1)
+     return -1;
+  blockId = semgid;
+  block = (SEM_BLOCK *) p;
+  return 0;
+}
+
+static int blockCheck (int semgid, unsigned int sindex)
+{
+  if ((semgid != blockId) || (sindex >= block->snum))
+     { errno = EINVAL;
+       return -1;
+     }
+  return 0;
+}
+
+static int tryDown (int semgid, unsigned int sindex)
+{
+  struct sembuf down = { 0, -1, IPC_NOWAIT };                              /* specific non-blocking down operation */
+
+  if (blockId != -1)
+     return (blockCheck (semgid, sindex) == -1) ? -1 : ops->trydown (blockSem (sindex));
+
+  down.sem_num = (unsigned short) sindex;
+  return semop (semgid, &down, 1);
+}
+
+/* the budget follows twice the average number of tries that paid off; a down that spins in vain halves it, so a
+   lock held for long stops burning processor time before blocking */
+static int spinDown (int semgid, unsigned int sindex)
+{
+  SEM_SPIN *s = &spin[sindex];
+  unsigned int n;
+
+  for (n = 0; n < s->budget; n++)
+  { if (tryDown (semgid, sindex) == 0)
+       { s->avg = (7 * s->avg + n) / 8;
+         s->budget = 2 * s->avg + SEM_SPINMIN;
+         if (s->budget > s->limit)
+            s->budget = s->limit;
+         return 0;
+       }
+    if (errno != EAGAIN)
+       return -1;
+    cpuRelax ();
+  }
+  s->budget /= 2;
+  if (s->budget < SEM_SPINMIN)
+     s->budget = (s->limit < SEM_SPINMIN) ? s->limit : SEM_SPINMIN;
+  return -1;
+}
+
+static int lockDown (int semgid, unsigned int sindex)
+{
+  struct sembuf down = { 0, -1, 0 };                                                      /* specific down operation */
+  struct timespec limit = { timeout / 1000, (long) (timeout % 1000) * 1000000 },  /* longest time the down may take */
+                  deadline;                                                 /* instant the down has to be done by */
+
+  if ((sindex < SEM_LOCAL) && (spin[sindex].limit > 0) && (spinDown (semgid, sindex) == 0))
+     return 0;
+  if (blockId != -1)
+     { if (blockCheck (semgid, sindex) == -1)
+          return -1;
+       if (timeout == 0)
+          return ops->down (blockSem (sindex), NULL);
+       clock_gettime (CLOCK_MONOTONIC, &deadline);
+       deadline.tv_sec += limit.tv_sec;
+       deadline.tv_nsec += limit.tv_nsec;
+       if (deadline.tv_nsec >= 1000000000)
+          { deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+          }
+       return ops->down (blockSem (sindex), &deadline);
+     }
+
+  down.sem_num = (unsigned short) sindex;
+  if (timeout == 0)
+     return semop (semgid, &down, 1);
+  if (semtimedop (semgid, &down, 1, &limit) == -1)
+     { if (errno == EAGAIN)                                               /* semtimedop reports a timeout as EAGAIN */
+          errno = ETIMEDOUT;
+       return -1;
+     }
+  return 0;
+}
+
+static uint64_t now (void)
+{
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+
+/* bin k holds the durations in [2^k, 2^(k+1)) ns, the first and the last ones also the shorter and the longer */
+static void count (uint64_t hist[], uint64_t ns)
+{
+  unsigned int k = (ns < 2) ? 0 : 63 - (unsigned int) __builtin_clzll (ns);
+
+  hist[(k < SEM_HISTBINS) ? k : SEM_HISTBINS - 1] += 1;
+}
+
+static void release (unsigned int sindex)
+{
+  if ((sindex <= statsNum) && (since[sindex] != 0))
+     { count (stats[sindex-1].hold, now () - since[sindex]);
+       since[sindex] = 0;
+     }
+}
+
+/* external functions */
+
+/**
+ *  \brief Selection of the backend of the sets created afterwards by the calling process.
+ *
+ *  \param name name of the backend ("sysv", "posix", "pthread" or "futex")
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when there is no backend with that name (<tt>errno</tt> is set to EINVAL)
+ */
+
+int semSelect (const char *name)
+{
+  unsigned int b;
+
+  if (strcmp (name, "sysv") == 0)
+     { selected = 0;
+       return 0;
+     }
+  for (b = 1; b < NBACKENDS; b++)
+    if (strcmp (name, backends[b]->name) == 0)
+       { selected = b;
+         return 0;
+       }
+  errno = EINVAL;
+  return -1;
+}
+
+/**
+ *  \brief Adaptive locking of a semaphore by the calling process.
+ *
+ *  Afterwards, a <em>down</em> of the semaphore by the calling process first tries it without blocking, pausing
+ *  between tries, and only blocks when the number of tries reaches a budget. The budget tunes itself to the tries
+ *  the past downs needed, up to <tt>limit</tt>. It is only worth it for semaphores guarding short critical regions,
+ *  and it is turned off on a single processor.
+ *
+ *  \param sindex semaphore location in the set (1 .. 63)
+ *  \param limit maximum number of tries before blocking (0 turns spinning off)
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the semaphore location is out of range (<tt>errno</tt> is set to EINVAL)
+ */
+
+int semSpin (unsigned int sindex, unsigned int limit)
+{
+  if ((sindex == 0) || (sindex >= SEM_LOCAL))
+     { errno = EINVAL;
+       return -1;
+     }
+  if (sysconf (_SC_NPROCESSORS_ONLN) < 2)                      /* the holder cannot run while the caller spins */
+     limit = 0;
+  spin[sindex].limit = limit;
+  spin[sindex].budget = limit;
+  spin[sindex].avg = 0;
+  return 0;
+}
+
+/**
+ *  \brief Instrumentation of the operations of the calling process on a set of semaphores.
+ *
+ *  Afterwards, each <em>down</em> of a semaphore by the calling process is counted in the semaphore's entry of
+ *  <tt>table</tt>, as contended when it could not be carried out at once, and its waiting time is added to a
+ *  histogram. The time from the <em>down</em> to the next <em>up</em> of the same semaphore by the calling process
+ *  is added to the hold time histogram. Each process should be given a table of its own.
+ *
+ *  \param table statistics, one entry per semaphore (entry 0 is semaphore 1), or NULL to turn instrumentation off
+ *  \param snum number of entries in the table (at most 63)
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when there are too many entries (<tt>errno</tt> is set to EINVAL)
+ */
+
+int semInstrument (SEM_USAGE *table, unsigned int snum)
+{
+  if (snum >= SEM_LOCAL)
+     { errno = EINVAL;
+       return -1;
+     }
+  memset (since, 0, sizeof (since));
+  stats = table;
+  statsNum = (table == NULL) ? 0 : snum;
+  return 0;
+}
+
+/**
+ *  \brief Time limit of the downs of the calling process.
+ *
+ *  Afterwards, a <em>down</em> of the calling process that stays blocked for longer than <tt>ms</tt> milliseconds
+ *  fails with <tt>errno</tt> set to ETIMEDOUT, so that a process which never gets the semaphore is detected
+ *  instead of hanging.
+ *
+ *  \param ms time limit (in ms, 0 waits forever)
+ */
+
+void semTimeout (unsigned int ms)
+{
+  timeout = ms;
+}
+
 /**
  *  \brief Creation of a set of semaphores.
  *
@@ -38,7 +365,31 @@
 
 int semCreate (int key, unsigned int snum)
 {
-  return semget ((key_t) key, snum+1, MASK | IPC_CREAT | IPC_EXCL);
+  int semgid;                                                                            /* semaphore set identifier */
+  unsigned int n;
+
+  if ((selected == NBACKENDS) && (semSelect (SEM_DEFAULT) == -1))
+     selected = 0;
+
+  if (selected == 0)
+     { if (shmget (blockKey (key), 1, MASK) != -1)              /* a stale block would capture the connections */
+          { errno = EEXIST;
+            return -1;
+          }
+       return semget ((key_t) key, snum+1, MASK | IPC_CREAT | IPC_EXCL);
+     }
+
+  if ((semgid = shmget (blockKey (key), SEM_SLOT * (snum + 2), MASK | IPC_CREAT | IPC_EXCL)) == -1)
+     return -1;
+  if (blockAttach (semgid) == -1)
+     return -1;
+  ops = backends[selected];
+  block->backend = selected;
+  block->snum = snum + 1;
+  for (n = 0; n <= snum; n++)
+    if (ops->init (blockSem (n)) == -1)
+       return -1;
+  return semgid;
 }
 
 /**
@@ -57,6 +408,19 @@ int semConnect (int key)
   int semgid;                                                                            /* semaphore set identifier */
   struct sembuf init[2] = {{ 0, -1, 0 }, {0, 1, 0}};                                     /* initialization operation */
 
+  if ((semgid = shmget (blockKey (key), 1, MASK)) != -1)
+     { if (blockAttach (semgid) == -1)
+          return -1;
+       if (block->backend >= NBACKENDS)
+          { errno = EINVAL;
+            return -1;
+          }
+       ops = backends[block->backend];
+       if ((ops->down (blockSem (0), NULL) == -1) || (ops->up (blockSem (0)) == -1))          /* initialization operation */
+          return -1;
+       return semgid;
+     }
+
   if ((semgid = semget ((key_t) key, 1, MASK)) == -1)
      return -1;
      else if (semop (semgid, init, 2) == -1)
@@ -77,6 +441,19 @@ int semConnect (int key)
 
 int semDestroy (int semgid)
 {
+  unsigned int n;
+
+  if (semgid == blockId)
+     { for (n = 0; (n < block->snum) && (ops->fini != NULL); n++)
+         ops->fini (blockSem (n));
+       if (shmctl (semgid, IPC_RMID, NULL) == -1)
+          return -1;
+       shmdt (block);
+       block = NULL;
+       blockId = -1;
+       return 0;
+     }
+
   return semctl (semgid, 0, IPC_RMID, NULL);
 }
 
@@ -95,6 +472,9 @@ int semSignal (int semgid)
 {
   struct sembuf up = { 0, 1, 0 };                                                         /* all around up operation */
 
+  if (blockId != -1)
+     return (blockCheck (semgid, 0) == -1) ? -1 : ops->up (blockSem (0));
+
   return semop (semgid, &up, 1);
 }
 
@@ -112,11 +492,22 @@ int semSignal (int semgid)
 
 int semDown (int semgid, unsigned int sindex)
 {
-  struct sembuf down = { 0, -1, 0 };                                                      /* specific down operation */
+  uint64_t t0;                                                                 /* instant the down was started at */
 
   assert(sindex>0);
-  down.sem_num = (unsigned short) sindex;
-  return semop (semgid, &down, 1);
+  if (sindex > statsNum)
+     return lockDown (semgid, sindex);
+
+  t0 = now ();
+  if (tryDown (semgid, sindex) == -1)
+     { if ((errno != EAGAIN) || (lockDown (semgid, sindex) == -1))
+          return -1;
+       stats[sindex-1].contended += 1;
+     }
+  since[sindex] = now ();
+  stats[sindex-1].acquires += 1;
+  count (stats[sindex-1].wait, since[sindex] - t0);
+  return 0;
 }
 
 /**
@@ -136,6 +527,82 @@ int semUp (int semgid, unsigned int sindex)
   struct sembuf up = { 0, 1, 0 };                                                           /* specific up operation */
 
   assert(sindex>0);
+  release (sindex);
+  if (blockId != -1)
+     return (blockCheck (semgid, sindex) == -1) ? -1 : ops->up (blockSem (sindex));
+
   up.sem_num = (unsigned short) sindex;
   return semop (semgid, &up, 1);
 }
+
+/**
+ *  \brief Value of a semaphore within the set.
+ *
+ *  The function fails if there is no semaphore set with an identifier equal to <tt>semgid</tt>.
+ *
+ *  \param semgid set identifier
+ *  \param sindex semaphore location in the set (1 .. snum)
+ *
+ *  \return value of the semaphore, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+
+int semValue (int semgid, unsigned int sindex)
+{
+  assert(sindex>0);
+  if (blockId != -1)
+     return (blockCheck (semgid, sindex) == -1) ? -1 : ops->value (blockSem (sindex));
+
+  return semctl (semgid, (int) sindex, GETVAL);
+}
+
+/**
+ *  \brief <em>Up</em> of several semaphores within the set at once.
+ *
+ *  With the "sysv" backend the whole batch is a single atomic <tt>semop</tt> call; the other backends carry the
+ *  operations out in order. Since an <em>up</em> never blocks, the outcome is the same as calling semUp for each
+ *  operation, in order.
+ *
+ *  The function fails if there is no semaphore set with an identifier equal to <tt>semgid</tt>.
+ *
+ *  \param semgid set identifier
+ *  \param list operations
+ *  \param n number of operations (>= 1)
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+
+int semUpMany (int semgid, SEM_OP list[], unsigned int n)
+{
+  struct sembuf up[n];                                                                    /* specific up operations */
+  unsigned int k;
+  int d;
+
+  for (k = 0; k < n; k++)
+  { assert(list[k].sindex>0);
+    if (list[k].delta < 1)
+       { errno = EINVAL;
+         return -1;
+       }
+    release (list[k].sindex);
+  }
+
+  if (blockId != -1)
+     { for (k = 0; k < n; k++)
+       { if (blockCheck (semgid, list[k].sindex) == -1)
+            return -1;
+         for (d = 0; d < list[k].delta; d++)
+           if (ops->up (blockSem (list[k].sindex)) == -1)
+              return -1;
+       }
+       return 0;
+     }
+
+  for (k = 0; k < n; k++)
+  { up[k].sem_num = (unsigned short) list[k].sindex;
+    up[k].sem_op = (short) list[k].delta;
+    up[k].sem_flg = 0;
+  }
+  return semop (semgid, up, n);
+}
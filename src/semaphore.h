@@ -8,8 +8,12 @@
  *     \li connection to a previously created set of semaphores
  *     \li destruction of a previously created set of semaphores
  *     \li signalling start of operations
- *     \li <em>down</em> of a semaphore within the set
- *     \li <em>up</em> of a semaphore within the set.
+ *     \li <em>down</em> of a semaphore within the set, optionally spinning before it blocks or with a time limit
+ *     \li <em>up</em> of a semaphore within the set
+ *     \li <em>up</em> of several semaphores within the set at once
+ *     \li reading the value of a semaphore within the set
+ *     \li instrumentation of the operations of the calling process
+ *     \li selection of the backend ("sysv", "posix", "pthread" or "futex").
  *
  *  \author António Rui Borges - October 1995
  */
@@ -17,6 +21,85 @@
 #ifndef SEMAPHORE_H_
 #define SEMAPHORE_H_
 
+#include <stdint.h>
+
+/** \brief number of bins of the time histograms (bin k counts durations of 2^k up to 2^(k+1) ns) */
+#define  SEM_HISTBINS   32
+
+/**
+ *  \brief Definition of <em>semaphore statistics</em> data type (operations of a process on a semaphore).
+ */
+typedef struct {
+    /** \brief number of downs carried out */
+    uint64_t acquires;
+    /** \brief number of downs that could not be carried out at once */
+    uint64_t contended;
+    /** \brief histogram of the time taken by the downs */
+    uint64_t wait[SEM_HISTBINS];
+    /** \brief histogram of the time from a down to the next up by the same process */
+    uint64_t hold[SEM_HISTBINS];
+} SEM_USAGE;
+
+/**
+ *  \brief Selection of the backend of the sets created afterwards by the calling process.
+ *
+ *  Processes connecting to a set use the backend it was created with, whatever they selected.
+ *  When no backend is selected, the one chosen at build time (make SEM=name, "sysv" by default) is used.
+ *
+ *  \param name name of the backend ("sysv", "posix", "pthread" or "futex")
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when there is no backend with that name (<tt>errno</tt> is set to EINVAL)
+ */
+
+extern int semSelect (const char *name);
+
+/**
+ *  \brief Adaptive locking of a semaphore by the calling process.
+ *
+ *  Afterwards, a <em>down</em> of the semaphore by the calling process first tries it without blocking, pausing
+ *  between tries, and only blocks when the number of tries reaches a budget. The budget tunes itself to the tries
+ *  the past downs needed, up to <tt>limit</tt>. It is only worth it for semaphores guarding short critical regions,
+ *  and it is turned off on a single processor.
+ *
+ *  \param sindex semaphore location in the set (1 .. 63)
+ *  \param limit maximum number of tries before blocking (0 turns spinning off)
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the semaphore location is out of range (<tt>errno</tt> is set to EINVAL)
+ */
+
+extern int semSpin (unsigned int sindex, unsigned int limit);
+
+/**
+ *  \brief Instrumentation of the operations of the calling process on a set of semaphores.
+ *
+ *  Afterwards, each <em>down</em> of a semaphore by the calling process is counted in the semaphore's entry of
+ *  <tt>table</tt>, as contended when it could not be carried out at once, and its waiting time is added to a
+ *  histogram. The time from the <em>down</em> to the next <em>up</em> of the same semaphore by the calling process
+ *  is added to the hold time histogram. Each process should be given a table of its own.
+ *
+ *  \param table statistics, one entry per semaphore (entry 0 is semaphore 1), or NULL to turn instrumentation off
+ *  \param snum number of entries in the table (at most 63)
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when there are too many entries (<tt>errno</tt> is set to EINVAL)
+ */
+
+extern int semInstrument (SEM_USAGE *table, unsigned int snum);
+
+/**
+ *  \brief Time limit of the downs of the calling process.
+ *
+ *  Afterwards, a <em>down</em> of the calling process that stays blocked for longer than <tt>ms</tt> milliseconds
+ *  fails with <tt>errno</tt> set to ETIMEDOUT, so that a process which never gets the semaphore is detected
+ *  instead of hanging.
+ *
+ *  \param ms time limit (in ms, 0 waits forever)
+ */
+
+extern void semTimeout (unsigned int ms);
+
 /**
  *  \brief Creation of a set of semaphores.
  *
@@ -99,4 +182,49 @@ extern int semDown (int semgid, unsigned int sindex);
 
 extern int semUp (int semgid, unsigned int sindex);
 
+/**
+ *  \brief Value of a semaphore within the set.
+ *
+ *  The function fails if there is no semaphore set with an identifier equal to <tt>semgid</tt>.
+ *
+ *  \param semgid set identifier
+ *  \param sindex semaphore location in the set (1 .. snum)
+ *
+ *  \return value of the semaphore, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+
+extern int semValue (int semgid, unsigned int sindex);
+
+/**
+ *  \brief Definition of <em>semaphore operation</em> data type, an element of a batch.
+ */
+typedef struct {
+    /** \brief semaphore location in the set (1 .. snum) */
+    unsigned int sindex;
+    /** \brief number of <em>up</em> operations (>= 1) */
+    int delta;
+} SEM_OP;
+
+/**
+ *  \brief <em>Up</em> of several semaphores within the set at once.
+ *
+ *  With the "sysv" backend the whole batch is a single atomic <tt>semop</tt> call; the other backends carry the
+ *  operations out in order. Since an <em>up</em> never blocks, the outcome is the same as calling semUp for each
+ *  operation, in order.
+ *  Batches with <em>down</em> operations are not provided: a <em>down</em> that blocks would keep the <em>up</em>
+ *  operations of its batch (typically the release of the mutex) from taking place.
+ *
+ *  The function fails if there is no semaphore set with an identifier equal to <tt>semgid</tt>.
+ *
+ *  \param semgid set identifier
+ *  \param list operations
+ *  \param n number of operations (>= 1)
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+
+extern int semUpMany (int semgid, SEM_OP list[], unsigned int n);
+
 #endif /* SEMAPHORE_H_ */
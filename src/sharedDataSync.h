@@ -19,6 +19,21 @@
 
 #include "probConst.h"
 #include "probDataStruct.h"
+#include "logging.h"
+#include "semaphore.h"
+#include "deliveryRing.h"
+
+/**
+ *  \brief Publication of the state of an entity.
+ *
+ *  Each field of STAT is only written by the entity it belongs to, so it is updated with an atomic store and
+ *  without entering the critical region or locking the log; the store is enclosed by beginUpdate and endUpdate,
+ *  like every other update of the full state, so that readers which take no lock never see a torn copy.
+ */
+#define SET_STAT(field, val)     __atomic_store_n (&SLOT (field), (unsigned int) (val), __ATOMIC_RELAXED)
+
+/** \brief number of semaphores in the set */
+#define SEM_NU               ( 3 + 2 * NUMINGREDIENTS + NUMSMOKERS )
 
 /**
  *  \brief Definition of <em>shared information</em> data type.
@@ -28,7 +43,8 @@ typedef struct
           FULL_STAT fSt;
 
           /* semaphores ids */
-          /** \brief identification of critical region protection semaphore – val = 1 */
+          /** \brief identification of critical region protection semaphore, which guards <tt>ingredients[]</tt>,
+           *         <tt>reserved[]</tt> and <tt>closing</tt> – val = 1 */
           unsigned int mutex;
           /** \brief identification of semaphore used by watchers to wait for agent - val = 0 */
           unsigned int ingredient[NUMINGREDIENTS];
@@ -37,14 +53,49 @@ typedef struct
           /** \brief identification of semaphore used by smoker to wait for watchers – val = 0  */
           unsigned int wait2Ings[NUMSMOKERS];
 
-        } SHARED_DATA;
+          /** \brief logging control block, common to all processes */
+          LOG_CTRL logCtrl;
 
-/** \brief number of semaphores in the set */
-#define SEM_NU               ( 2 + NUMINGREDIENTS + NUMSMOKERS )
+          /** \brief ring of records drained by the logger process */
+          LOG_RING logRing;
+
+          /** \brief maximum number of tries of a down of the mutex before blocking (0: no spinning) */
+          unsigned int spin;
+
+          /** \brief longest time a down may block (ms, 0: no limit) */
+          unsigned int timeout;
+
+          /** \brief the operations on the semaphores are instrumented */
+          bool instrument;
+
+          /** \brief statistics of the operations of each process (by LOG_AGENT, LOG_WATCHER and LOG_SMOKER id) on
+           *         each semaphore (entry 0 is semaphore 1) */
+          SEM_USAGE semStats[LOG_LOGGER][SEM_NU];
+
+          /** \brief the ingredient and reservation locks are used instead of the mutex (see sharedLocks.h) */
+          bool fineLocks;
+          /** \brief identification of the semaphores guarding each ingredient in fine-grained locking – val = 1 */
+          unsigned int ingLock[NUMINGREDIENTS];
+          /** \brief identification of the semaphore guarding the matching of reservations in fine-grained locking
+           *         – val = 1 */
+          unsigned int reserveLock;
+
+          /** \brief the ingredients are delivered through the rings instead of the <tt>ingredient[]</tt> semaphores */
+          bool rings;
+          /** \brief ring of the ingredients delivered to each watcher, which blocks on its <tt>ingredient[]</tt>
+           *         semaphore only when the ring is empty */
+          DELIVERY_RING delivery[NUMINGREDIENTS];
+
+          /** \brief seed of the random generators of the run (0: each process seeds its own from its pid) */
+          unsigned int seed;
+
+        } SHARED_DATA;
 
 #define MUTEX                  1
 #define WAITCIGARETTE          2
 #define INGREDIENT             (WAITCIGARETTE + 1)
 #define WAIT2INGS              (INGREDIENT + NUMINGREDIENTS)
+#define INGLOCK                (WAIT2INGS + NUMSMOKERS)
+#define RESERVELOCK            (INGLOCK + NUMINGREDIENTS)
 
 #endif /* SHAREDDATASYNC_H_ */
@@ -0,0 +1,173 @@
+/**
+ *  \file sharedLocks.c (implementation file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Locking of the shared data.
+ *
+ *  Operations defined on the locks of the shared region:
+ *     \li locking of a set of locks, in the lock order
+ *     \li composition of the up operations that unlock a set of locks
+ *     \li unlocking of a set of locks
+ *     \li adaptive locking of every lock
+ *     \li reading of a snapshot of the full state without locking
+ *     \li parsing of the key of a run given on the command line.
+ *
+ *  Lock order: the reservation lock, then the ingredient locks by increasing ingredient, then the log lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sharedLocks.h"
+
+/**
+ *  \brief Locking of a set of locks, in the lock order.
+ *
+ *  The calling process terminates when a down fails.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param sh pointer to the shared region
+ *  \param set locks (LOCK_ING and LOCK_RESERVE values, or-ed)
+ *  \param who id of the calling process in error messages (AG, WT or SM)
+ */
+void lockRegion (int semgid, SHARED_DATA *sh, unsigned int set, const char *who)
+{
+    char msg[64];
+    unsigned int i;
+
+    sprintf (msg, "error on the down operation for semaphore access (%s)", who);
+    if (!sh->fineLocks) {
+        if (semDown (semgid, sh->mutex) == -1) {
+            perror (msg);
+            exit (EXIT_FAILURE);
+        }
+        return;
+    }
+
+    if ((set & LOCK_RESERVE) && (semDown (semgid, sh->reserveLock) == -1)) {
+        perror (msg);
+        exit (EXIT_FAILURE);
+    }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        if ((set & LOCK_ING (i)) && (semDown (semgid, sh->ingLock[i]) == -1)) {
+            perror (msg);
+            exit (EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ *  \brief Composition of the up operations that unlock a set of locks.
+ *
+ *  \param sh pointer to the shared region
+ *  \param set locks (LOCK_ING and LOCK_RESERVE values, or-ed)
+ *  \param ops where the operations are stored (room for LOCK_MAXOPS)
+ *
+ *  \return number of operations stored
+ */
+unsigned int unlockOps (SHARED_DATA *sh, unsigned int set, SEM_OP ops[])
+{
+    unsigned int i, n = 0;
+
+    if (!sh->fineLocks) {
+        ops[n++] = (SEM_OP) { sh->mutex, 1 };
+        return n;
+    }
+
+    for (i = NUMINGREDIENTS; i > 0; i--) {
+        if (set & LOCK_ING (i - 1)) {
+            ops[n++] = (SEM_OP) { sh->ingLock[i-1], 1 };
+        }
+    }
+    if (set & LOCK_RESERVE) {
+        ops[n++] = (SEM_OP) { sh->reserveLock, 1 };
+    }
+    return n;
+}
+
+/**
+ *  \brief Unlocking of a set of locks.
+ *
+ *  The calling process terminates when an up fails.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param sh pointer to the shared region
+ *  \param set locks (LOCK_ING and LOCK_RESERVE values, or-ed)
+ *  \param who id of the calling process in error messages (AG, WT or SM)
+ */
+void unlockRegion (int semgid, SHARED_DATA *sh, unsigned int set, const char *who)
+{
+    SEM_OP ops[LOCK_MAXOPS];
+    unsigned int n = unlockOps (sh, set, ops);
+    char msg[64];
+
+    if ((n > 0) && (semUpMany (semgid, ops, n) == -1)) {
+        sprintf (msg, "error on the up operation for semaphore access (%s)", who);
+        perror (msg);
+        exit (EXIT_FAILURE);
+    }
+}
+
+/**
+ *  \brief Adaptive locking of every lock (the mutex, the ingredient locks and the reservation lock).
+ *
+ *  See semSpin; the maximum number of tries is <tt>spin</tt> in the shared region.
+ *
+ *  \param sh pointer to the shared region
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+int spinRegion (SHARED_DATA *sh)
+{
+    unsigned int i;
+
+    if ((semSpin (sh->mutex, sh->spin) == -1) || (semSpin (sh->reserveLock, sh->spin) == -1)) {
+        return -1;
+    }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        if (semSpin (sh->ingLock[i], sh->spin) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  \brief Reading of a snapshot of the full state without locking.
+ *
+ *  The full state is copied optimistically and the copy is taken again whenever the sequence number of some
+ *  writer (see beginUpdate) shows that an update was in progress or happened meanwhile, so the copy is consistent
+ *  and the entities are never held up by the reader.
+ *
+ *  \param sh pointer to the shared region
+ *  \param snap where the snapshot is stored
+ *
+ *  \return number of copies discarded because they were torn
+ */
+unsigned int readSnapshot (SHARED_DATA *sh, FULL_STAT *snap)
+{
+    return readState (&sh->logCtrl, &sh->fSt, snap);
+}
+
+/**
+ *  \brief Parsing of the key of a run given on the command line.
+ *
+ *  \param text key, in decimal, octal or hexadecimal
+ *
+ *  \return key of the run, upon success
+ *  \return -\c 1, when the text is not a valid key
+ */
+int parseKey (const char *text)
+{
+    unsigned long key;
+    char *tinp;
+
+    key = strtoul (text, &tinp, 0);
+    if ((*text == '\0') || (*text == '-') || (*tinp != '\0') || (key == 0) || (key > 0xffffffffUL) ||
+        ((key > 0xffffff) && ((key & 0xff000000UL) != KEY_PROJECT))) {
+        return -1;
+    }
+    return (int) ((unsigned int) key | KEY_PROJECT);
+}
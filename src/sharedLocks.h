@@ -0,0 +1,122 @@
+/**
+ *  \file sharedLocks.h (interface file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Locking of the shared data.
+ *
+ *  Operations defined on the locks of the shared region:
+ *     \li locking of a set of locks, in the lock order
+ *     \li composition of the up operations that unlock a set of locks
+ *     \li unlocking of a set of locks
+ *     \li adaptive locking of every lock
+ *     \li reading of a snapshot of the full state without locking
+ *     \li parsing of the key of a run given on the command line.
+ *
+ *  With the single lock (default), every set stands for the mutex, even the empty one.
+ *  With fine-grained locks (<tt>fineLocks</tt> in the shared region), each ingredient has a lock of its own,
+ *  which guards <tt>ingredients[i]</tt> and the reservation of <tt>reserved[i]</tt>, and the reservation lock
+ *  guards the consumption of two reservations into a cigarette, and <tt>closing</tt>. The reservations are changed
+ *  with atomic operations, so a watcher reserves holding only the lock of its ingredient and reads the others
+ *  without locking; a match is checked again under the reservation lock before it is consumed.
+ *
+ *  Lock order: the reservation lock, then the ingredient locks by increasing ingredient, then the log lock
+ *  (lockLog). A set is always locked in this order and unlocked at once, so no two processes can deadlock.
+ */
+
+#ifndef SHAREDLOCKS_H_
+#define SHAREDLOCKS_H_
+
+#include "sharedDataSync.h"
+#include "semaphore.h"
+
+/** \brief lock of ingredient i */
+#define  LOCK_ING(i)          (1u << (i))
+
+/** \brief reservation lock */
+#define  LOCK_RESERVE         (1u << NUMINGREDIENTS)
+
+/** \brief project id 'a' in the first byte of the keys of the runs, as in the keys of ftok */
+#define  KEY_PROJECT          0x61000000u
+
+/** \brief greatest number of up operations that unlock a set */
+#define  LOCK_MAXOPS          (1 + NUMINGREDIENTS)
+
+/**
+ *  \brief Locking of a set of locks, in the lock order.
+ *
+ *  The calling process terminates when a down fails.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param sh pointer to the shared region
+ *  \param set locks (LOCK_ING and LOCK_RESERVE values, or-ed)
+ *  \param who id of the calling process in error messages (AG, WT or SM)
+ */
+extern void lockRegion (int semgid, SHARED_DATA *sh, unsigned int set, const char *who);
+
+/**
+ *  \brief Composition of the up operations that unlock a set of locks.
+ *
+ *  They let a process leave the region and signal other processes in a single semUpMany call.
+ *
+ *  \param sh pointer to the shared region
+ *  \param set locks (LOCK_ING and LOCK_RESERVE values, or-ed)
+ *  \param ops where the operations are stored (room for LOCK_MAXOPS)
+ *
+ *  \return number of operations stored
+ */
+extern unsigned int unlockOps (SHARED_DATA *sh, unsigned int set, SEM_OP ops[]);
+
+/**
+ *  \brief Unlocking of a set of locks.
+ *
+ *  The calling process terminates when an up fails.
+ *
+ *  \param semgid semaphore set access identifier
+ *  \param sh pointer to the shared region
+ *  \param set locks (LOCK_ING and LOCK_RESERVE values, or-ed)
+ *  \param who id of the calling process in error messages (AG, WT or SM)
+ */
+extern void unlockRegion (int semgid, SHARED_DATA *sh, unsigned int set, const char *who);
+
+/**
+ *  \brief Adaptive locking of every lock (the mutex, the ingredient locks and the reservation lock).
+ *
+ *  See semSpin; the maximum number of tries is <tt>spin</tt> in the shared region.
+ *
+ *  \param sh pointer to the shared region
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+extern int spinRegion (SHARED_DATA *sh);
+
+/**
+ *  \brief Reading of a snapshot of the full state without locking.
+ *
+ *  The full state is copied optimistically and the copy is taken again whenever the sequence number of some
+ *  writer (see beginUpdate) shows that an update was in progress or happened meanwhile, so the copy is consistent
+ *  and the entities are never held up by the reader. It is meant for monitors sampling the state of a run.
+ *
+ *  \param sh pointer to the shared region
+ *  \param snap where the snapshot is stored
+ *
+ *  \return number of copies discarded because they were torn
+ */
+extern unsigned int readSnapshot (SHARED_DATA *sh, FULL_STAT *snap);
+
+/**
+ *  \brief Parsing of the key of a run given on the command line.
+ *
+ *  The block of semaphores of the backends is found through the low 24 bits of the key (see semaphore.c), so a key
+ *  given takes up to 24 bits and gets the project id in its first byte (KEY_PROJECT); a key that already has it is
+ *  taken as it is. The main program, the monitor and run/clean.sh all read a key this way.
+ *
+ *  \param text key, in decimal, octal or hexadecimal
+ *
+ *  \return key of the run, upon success
+ *  \return -\c 1, when the text is not a number, or the number is zero or does not fit the rule above
+ */
+extern int parseKey (const char *text);
+
+#endif /* SHAREDLOCKS_H_ */
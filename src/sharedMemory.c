@@ -8,18 +8,225 @@
  *      \li connection to a previously created block
  *      \li destruction of a previously created block
  *      \li mapping of the block previously created on the process address space
- *      \li unmapping of the block off the process address space.
+ *      \li unmapping of the block off the process address space
+ *      \li selection of the backend
+ *      \li passing of the block to a process started with exec
+ *      \li keeping the block open across the exec of the calling process.
+ *
+ *  The block is a SysV shared memory block (backend "sysv"), or a file mapped with <tt>mmap</tt>: an anonymous
+ *  <tt>memfd_create</tt> file (backend "memfd") or a POSIX shared memory object, unlinked as soon as it is created
+ *  (backend "posix"). A file has no key: its block identifier is the file descriptor, which the processes started
+ *  with exec inherit and learn from the text shmemExport composes, to be appended to the key in their arguments.
+ *  The descriptor is close-on-exec, so that only the processes that call shmemInherit before exec inherit it.
+ *  The default backend is set at build time (make SHM=name); a process may select another one before creating a
+ *  block.
  *
  *  \author António Rui Borges - October 1995
  */
 
+#define _GNU_SOURCE                                                         /* memfd_create, MAP_POPULATE, MFD_HUGETLB */
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+
+#include "sharedMemory.h"
 
 /** \brief access permission: user r-w */
 #define  MASK           0600
 
+/** \brief backend selected when none is (make SHM=name) */
+#ifndef SHM_DEFAULT
+#define  SHM_DEFAULT    "sysv"
+#endif
+
+/** \brief backends */
+enum { SHM_SYSV, SHM_MEMFD, SHM_POSIX, SHM_NONE };
+
+/** \brief names of the backends */
+static const char *names[] = { "sysv", "memfd", "posix" };
+
+/** \brief backend of the blocks created or connected to by the calling process */
+static unsigned int backend = SHM_NONE;
+
+/** \brief options of the mapping (SHMEM_HUGE, SHMEM_POPULATE and SHMEM_LOCK values, or-ed) */
+static unsigned int options = 0;
+
+/** \brief file descriptor inherited from the creator (-1 when none) */
+static int inherited = -1;
+
+/** \brief size of the mapping of the block (file backends) */
+static size_t mapped = 0;
+
+/* size of a huge page (2 MiB when it can not be read) */
+static size_t hugeSize (void)
+{
+  FILE *fic;
+  char line[80];
+  size_t kb = 2048;
+
+  if ((fic = fopen ("/proc/meminfo", "r")) != NULL)
+     { while (fgets (line, sizeof (line), fic) != NULL)
+         if (sscanf (line, "Hugepagesize: %zu kB", &kb) == 1)
+            break;
+       fclose (fic);
+     }
+  return kb * 1024;
+}
+
+/* file of a given size, backed by huge pages if they were asked for and are available */
+static int createFile (int key, size_t size)
+{
+  char name[32];
+  size_t huge = hugeSize ();
+  void *add;
+  int fd;
+
+  if ((backend == SHM_MEMFD) && (options & SHMEM_HUGE))
+     { if ((fd = memfd_create ("smokers", MFD_CLOEXEC | MFD_HUGETLB)) != -1)
+          { /* huge pages are only there if they were reserved: mapping them all tells */
+            size = (size + huge - 1) / huge * huge;
+            if ((ftruncate (fd, (off_t) size) == 0) &&
+                ((add = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0)) != MAP_FAILED))
+               { munmap (add, size);
+                 return fd;
+               }
+            close (fd);
+          }
+     }                                                           /* otherwise, transparent huge pages are advised */
+
+  if (backend == SHM_MEMFD)
+     fd = memfd_create ("smokers", MFD_CLOEXEC);
+     else { snprintf (name, sizeof (name), "/smokers.%d.%d", key, (int) getpid ());
+            if ((fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, MASK)) != -1)  /* close-on-exec, as memfd above */
+               shm_unlink (name);
+          }
+  if (fd == -1)
+     return -1;
+  if (options & SHMEM_HUGE)
+     size = (size + huge - 1) / huge * huge;
+  if (ftruncate (fd, (off_t) size) == -1)
+     { close (fd);
+       return -1;
+     }
+  return fd;
+}
+
+/**
+ *  \brief Selection of the backend of the blocks created afterwards by the calling process.
+ *
+ *  The name of the backend may be followed by options of the mapping, separated by commas: "huge" (huge pages:
+ *  reserved ones if there are, transparent ones otherwise), "populate" (the pages are allocated and mapped at once)
+ *  and "lock" (the pages are locked in memory). Only the file backends take options, which also apply to the
+ *  processes the block is passed to.
+ *
+ *  \param spec name of the backend ("sysv", "memfd" or "posix"), optionally followed by options
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when there is no backend with that name, or an option is unknown or not supported by the backend
+ *          (<tt>errno</tt> is set to EINVAL)
+ */
+
+int shmemSelect (const char *spec)
+{
+  char buf[64], *opt, *save;
+  unsigned int b, opts = 0;
+
+  snprintf (buf, sizeof (buf), "%s", spec);
+  opt = strtok_r (buf, ",", &save);
+  for (b = 0; b < SHM_NONE; b++)
+    if ((opt != NULL) && (strcmp (opt, names[b]) == 0))
+       break;
+  while ((b < SHM_NONE) && ((opt = strtok_r (NULL, ",", &save)) != NULL))
+    if (strcmp (opt, "huge") == 0)
+       opts |= SHMEM_HUGE;
+       else if (strcmp (opt, "populate") == 0)
+               opts |= SHMEM_POPULATE;
+               else if (strcmp (opt, "lock") == 0)
+                       opts |= SHMEM_LOCK;
+                       else b = SHM_NONE;
+  if ((b == SHM_NONE) || ((b == SHM_SYSV) && (opts != 0)))
+     { errno = EINVAL;
+       return -1;
+     }
+  backend = b;
+  options = opts;
+  return 0;
+}
+
+/**
+ *  \brief Passing of a block to the processes the calling process starts with exec.
+ *
+ *  The text composed is empty for a SysV block, and identifies the file and the options of the mapping otherwise.
+ *  It is meant to follow the key in the arguments of the processes, which hand it to shmemImport.
+ *
+ *  \param shmid block identifier
+ *  \param text where the text is stored (room for SHMEM_EXPORTLEN characters)
+ */
+
+void shmemExport (int shmid, char *text)
+{
+  if (backend == SHM_SYSV)
+     text[0] = '\0';
+     else snprintf (text, SHMEM_EXPORTLEN, ":%d:%u", shmid, options);
+}
+
+/**
+ *  \brief Connection of the calling process to a block passed by the process that started it.
+ *
+ *  Afterwards, shmemConnect returns the file inherited instead of looking for a SysV block.
+ *
+ *  \param text text composed by shmemExport in the process that created the block
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the text is malformed (<tt>errno</tt> is set to EINVAL) or the file was not inherited
+ */
+
+int shmemImport (const char *text)
+{
+  int fd, n = 0;
+  unsigned int opts;
+
+  if (text[0] == '\0')
+     return 0;
+  if ((sscanf (text, ":%d:%u%n", &fd, &opts, &n) != 2) || (text[n] != '\0') || (fd < 0))
+     { errno = EINVAL;
+       return -1;
+     }
+  if (fcntl (fd, F_SETFD, FD_CLOEXEC) == -1)                        /* not passed on to the processes it starts */
+     return -1;
+  backend = SHM_MEMFD;                                                 /* both file backends are mapped alike */
+  options = opts;
+  inherited = fd;
+  return 0;
+}
+
+/**
+ *  \brief Keeping a block open across the exec of the calling process.
+ *
+ *  The descriptor of a file is close-on-exec; a child process about to start a process the block is passed to
+ *  calls this function between fork and exec. It does nothing for a SysV block.
+ *
+ *  \param shmid block identifier
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+
+int shmemInherit (int shmid)
+{
+  if (backend == SHM_SYSV)
+     return 0;
+  return fcntl (shmid, F_SETFD, 0);
+}
+
 /**
  *  \brief Creation of a new block.
  *
@@ -34,7 +241,12 @@
 
 int shmemCreate (int key, unsigned int size)
 {
-  return shmget ((key_t) key, size, MASK | IPC_CREAT | IPC_EXCL);
+  if ((backend == SHM_NONE) && (shmemSelect (SHM_DEFAULT) == -1))
+     backend = SHM_SYSV;
+
+  if (backend == SHM_SYSV)
+     return shmget ((key_t) key, size, MASK | IPC_CREAT | IPC_EXCL);
+  return createFile (key, size);
 }
 
 /**
@@ -50,7 +262,11 @@ int shmemCreate (int key, unsigned int size)
 
 int shmemConnect (int key)
 {
-  return shmget ((key_t) key, 1, MASK);
+  struct stat st;
+
+  if (inherited == -1)
+     return shmget ((key_t) key, 1, MASK);
+  return (fstat (inherited, &st) == -1) ? -1 : inherited;
 }
 
 /**
@@ -66,7 +282,9 @@ int shmemConnect (int key)
 
 int shmemDestroy (int shmid)
 {
-  return shmctl (shmid, IPC_RMID, (struct shmid_ds *) NULL);
+  if ((backend == SHM_SYSV) || (backend == SHM_NONE))
+     return shmctl (shmid, IPC_RMID, (struct shmid_ds *) NULL);
+  return close (shmid);                                        /* the file goes away with the last descriptor */
 }
 
 /**
@@ -84,13 +302,29 @@ int shmemDestroy (int shmid)
 int shmemAttach (int shmid, void **pAttAdd)
 {
   void *add;                                                                                    /* temporary pointer */
+  struct stat st;
 
-  add = shmat (shmid, (char *) NULL, 0);
-  if (add != (void *) -1)
-     { *pAttAdd = (void *) add;
-       return 0;
+  if ((backend == SHM_SYSV) || (backend == SHM_NONE))
+     { add = shmat (shmid, (char *) NULL, 0);
+       if (add == (void *) -1)
+          return -1;
      }
-     else return 1;
+     else { if (fstat (shmid, &st) == -1)
+               return -1;
+            mapped = (size_t) st.st_size;
+            add = mmap (NULL, mapped, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | ((options & SHMEM_POPULATE) ? MAP_POPULATE : 0), shmid, 0);
+            if (add == MAP_FAILED)
+               return -1;
+            if (options & SHMEM_HUGE)
+               madvise (add, mapped, MADV_HUGEPAGE);         /* fails harmlessly on reserved huge pages */
+            if ((options & SHMEM_LOCK) && (mlock (add, mapped) == -1))
+               { munmap (add, mapped);
+                 return -1;
+               }
+          }
+  *pAttAdd = (void *) add;
+  return 0;
 }
 
 /**
@@ -107,5 +341,7 @@ int shmemAttach (int shmid, void **pAttAdd)
 
 int shmemDettach (void *attAdd)
 {
-  return shmdt (attAdd);
+  if ((backend == SHM_SYSV) || (backend == SHM_NONE))
+     return shmdt (attAdd);
+  return munmap (attAdd, mapped);
 }
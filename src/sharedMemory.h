@@ -8,7 +8,10 @@
  *      \li connection to a previously created block
  *      \li destruction of a previously created block
  *      \li mapping of the block previously created on the process address space
- *      \li unmapping of the block off the process address space.
+ *      \li unmapping of the block off the process address space
+ *      \li selection of the backend ("sysv", "memfd" or "posix")
+ *      \li passing of the block to a process started with exec
+ *      \li keeping the block open across the exec of the calling process.
  *
  *  \author António Rui Borges - October 1995
  */
@@ -16,6 +19,76 @@
 #ifndef SHAREDMEMORY_H_
 #define SHAREDMEMORY_H_
 
+/** \brief option of the mapping: huge pages */
+#define  SHMEM_HUGE           1u
+/** \brief option of the mapping: the pages are allocated and mapped at once */
+#define  SHMEM_POPULATE       2u
+/** \brief option of the mapping: the pages are locked in memory */
+#define  SHMEM_LOCK           4u
+
+/** \brief room for the text composed by shmemExport (with the terminating null character) */
+#define  SHMEM_EXPORTLEN      24
+
+/**
+ *  \brief Selection of the backend of the blocks created afterwards by the calling process.
+ *
+ *  The name of the backend may be followed by options of the mapping, separated by commas: "huge" (huge pages:
+ *  reserved ones if there are, transparent ones otherwise), "populate" (the pages are allocated and mapped at once)
+ *  and "lock" (the pages are locked in memory). Only the file backends take options, which also apply to the
+ *  processes the block is passed to.
+ *  When no backend is selected, the one chosen at build time (make SHM=name, "sysv" by default) is used.
+ *
+ *  \param spec name of the backend ("sysv", "memfd" or "posix"), optionally followed by options
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when there is no backend with that name, or an option is unknown or not supported by the backend
+ *          (<tt>errno</tt> is set to EINVAL)
+ */
+
+extern int shmemSelect (const char *spec);
+
+/**
+ *  \brief Passing of a block to the processes the calling process starts with exec.
+ *
+ *  A SysV block is found through its key, but a file (backends "memfd" and "posix") is only reachable through the
+ *  descriptor the processes inherit. The text composed is empty for a SysV block, and identifies the file and the
+ *  options of the mapping otherwise. It is meant to follow the key in the arguments of the processes, which hand
+ *  it to shmemImport.
+ *
+ *  \param shmid block identifier
+ *  \param text where the text is stored (room for SHMEM_EXPORTLEN characters)
+ */
+
+extern void shmemExport (int shmid, char *text);
+
+/**
+ *  \brief Connection of the calling process to a block passed by the process that started it.
+ *
+ *  Afterwards, shmemConnect returns the file inherited instead of looking for a SysV block.
+ *
+ *  \param text text composed by shmemExport in the process that created the block
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when the text is malformed (<tt>errno</tt> is set to EINVAL) or the file was not inherited
+ */
+
+extern int shmemImport (const char *text);
+
+/**
+ *  \brief Keeping a block open across the exec of the calling process.
+ *
+ *  The descriptor of a file (backends "memfd" and "posix") is close-on-exec, so that it only reaches the processes
+ *  the block is passed to: a child process about to start one of them calls this function between fork and exec.
+ *  It does nothing for a SysV block.
+ *
+ *  \param shmid block identifier
+ *
+ *  \return \c 0, upon success
+ *  \return -\c 1, when an error occurs (the actual situation is reported in <tt>errno</tt>)
+ */
+
+extern int shmemInherit (int shmid);
+
 /**
  *  \brief Creation of a new block.
  *
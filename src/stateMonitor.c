@@ -0,0 +1,187 @@
+/**
+ *  \file stateMonitor.c (implementation file)
+ *
+ *  \brief Problem name: Smokers
+ *
+ *  Sampling of the full state of a running simulation, without taking any of its locks.
+ *
+ *  The monitor connects to the shared region of the simulation started in the current directory (or the one with
+ *  the given key) and reads a snapshot of the full state (readSnapshot) periodically, writing a CSV line with the
+ *  time elapsed and the fields of the state whenever it changed. It stops once every entity is closing, or once
+ *  the simulation detached from the region; the number of samples and of torn copies is written on the standard
+ *  error. The columns are the ones of the CSV output of logDecode. Only the SysV shared memory backend can be
+ *  reached from outside the simulation.
+ *
+ *  Upon execution, the following parameters are accepted:
+ *    \li <tt>-p us</tt> time between samples (in us, 1000 by default; 0 samples without pausing)
+ *    \li <tt>-a</tt> a line is written for every sample, changed or not
+ *    \li <tt>-n N</tt> the monitor stops after N samples
+ *    \li <tt>-k key</tt> key of the shared region (the one of the simulation started in the current directory by
+ *        default): the key given to the simulation with -k, either as typed or as reported by -k auto, which is
+ *        normalized the same way (parseKey).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "probConst.h"
+#include "probDataStruct.h"
+#include "logging.h"
+#include "sharedDataSync.h"
+#include "sharedMemory.h"
+#include "sharedLocks.h"
+
+/** \brief number of tries to connect to the shared region, 10 ms apart */
+#define  CONNECT_TRIES  200
+
+/**
+ *  \brief Printing the command line syntax and terminating.
+ *
+ *  \param prog name of the program
+ */
+static void usage (char *prog)
+{
+    fprintf (stderr, "USAGE: %s [-p us] [-a] [-n N] [-k key]\n", prog);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ *  \brief Checking whether every entity is closing.
+ *
+ *  \param p_fSt pointer to the full state
+ */
+static bool closed (FULL_STAT *p_fSt)
+{
+    unsigned int i;
+
+    if (SLOT (p_fSt->st.agentStat) != CLOSING_A) {
+        return false;
+    }
+    for (i = 0; i < NUMINGREDIENTS; i++) {
+        if (SLOT (p_fSt->st.watcherStat[i]) != CLOSING_W) {
+            return false;
+        }
+    }
+    for (i = 0; i < NUMSMOKERS; i++) {
+        if (SLOT (p_fSt->st.smokerStat[i]) != CLOSING_S) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ *  \brief Main program.
+ */
+int main (int argc, char *argv[])
+{
+    int key = -1;                                                                         /* key of the shared region */
+    int shmid;                                                                     /* shared memory access identifier */
+    SHARED_DATA *sh;                                                                  /* pointer to the shared region */
+    FULL_STAT snap,                                                                                  /* latest sample */
+              last;                                                                /* sample of the last line written */
+    unsigned long period = 1000,                                                         /* time between samples (us) */
+                  limit = 0,                                                       /* number of samples (0: no limit) */
+                  samples = 0,                                                             /* number of samples taken */
+                  lines = 0,                                                               /* number of lines written */
+                  torn = 0;                                                        /* number of torn copies discarded */
+    bool all = false;                                                                      /* every sample is written */
+    struct shmid_ds ds;                                                                       /* status of the region */
+    struct timespec t0, now;
+    unsigned int f, tries;
+    char *tinp;                                                                     /* numerical parameters test flag */
+    int opt;                                                                                   /* command line option */
+
+    while ((opt = getopt (argc, argv, "p:an:k:")) != -1) {
+        switch (opt) {
+            case 'p': period = strtoul (optarg, &tinp, 0);
+                      if (*tinp != '\0') {
+                          usage (argv[0]);
+                      }
+                      break;
+            case 'a': all = true;
+                      break;
+            case 'n': limit = strtoul (optarg, &tinp, 0);
+                      if (*tinp != '\0') {
+                          usage (argv[0]);
+                      }
+                      break;
+            case 'k': if ((key = parseKey (optarg)) == -1) {
+                          usage (argv[0]);
+                      }
+                      break;
+            default:  usage (argv[0]);
+        }
+    }
+    if (optind < argc) {
+        usage (argv[0]);
+    }
+    if ((key == -1) && ((key = ftok (".", 'a')) == -1)) {
+        perror ("error on generating the key");
+        exit (EXIT_FAILURE);
+    }
+
+    /* the monitor may be started along with the simulation */
+    for (tries = 0; (shmid = shmemConnect (key)) == -1; tries++) {
+        if (tries == CONNECT_TRIES) {
+            perror ("error on connecting to the shared memory region");
+            exit (EXIT_FAILURE);
+        }
+        usleep (10000);
+    }
+    if (shmemAttach (shmid, (void **) &sh) == -1) {
+        perror ("error on mapping the shared region on the process address space");
+        exit (EXIT_FAILURE);
+    }
+
+    printf ("time_us,AG");
+    for (f = 0; f < NUMINGREDIENTS; f++) {
+        printf (",W%02u", f);
+    }
+    for (f = 0; f < NUMSMOKERS; f++) {
+        printf (",S%02u", f);
+    }
+    for (f = 0; f < NUMINGREDIENTS; f++) {
+        printf (",I%02u", f);
+    }
+    for (f = 0; f < NUMSMOKERS; f++) {
+        printf (",C%02u", f);
+    }
+    printf ("\n");
+
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    while ((limit == 0) || (samples < limit)) {
+        torn += readSnapshot (sh, &snap);
+        samples += 1;
+        if (all || (lines == 0) || (memcmp (&snap, &last, sizeof (FULL_STAT)) != 0)) {
+            clock_gettime (CLOCK_MONOTONIC, &now);
+            printf ("%ld", (long) ((now.tv_sec - t0.tv_sec) * 1000000 + (now.tv_nsec - t0.tv_nsec) / 1000));
+            for (f = 0; f < LOG_NFIELDS; f++) {
+                printf (",%d", getLogField (&snap, f));
+            }
+            printf ("\n");
+            last = snap;
+            lines += 1;
+        }
+        if (closed (&snap) || ((shmctl (shmid, IPC_STAT, &ds) == 0) && (ds.shm_nattch <= 1))) {
+            break;
+        }
+        if (period > 0) {
+            usleep (period);
+        }
+    }
+
+    fprintf (stderr, "%lu samples, %lu lines, %lu torn copies discarded\n", samples, lines, torn);
+    if (shmemDettach (sh) == -1) {
+        perror ("error on unmapping the shared region off the process address space");
+        exit (EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+}